@@ -23,3 +23,14 @@ int posix_spawnp(pid_t *pid, const char *file,
     return __spawni(pid, file, file_actions, attrp, argv, envp, SPAWN_XFLAGS_USE_PATH);
 }
 
+
+/* Like posix_spawnp, but 'path' is not searched for in PATH.
+ * This must be overridden as well, or glibc's version would be used,
+ * which does not know about our attributes. */
+int posix_spawn(pid_t *pid, const char *path,
+                const posix_spawn_file_actions_t *file_actions,
+                const posix_spawnattr_t *attrp,
+                char *const argv[], char *const envp[])
+{
+    return __spawni(pid, path, file_actions, attrp, argv, envp, 0);
+}
@@ -35,7 +35,11 @@ typedef struct
   struct sched_param __sp;
   int __policy;
   int __tcpgrp;
-  int __pad[15];
+  int __cgroup;
+  int *__pidfd;
+  const void *__affinity;
+  size_t __affinitysize;
+  int __pad[8];
 } posix_spawnattr_t;
 
 
@@ -61,6 +65,9 @@ typedef struct
 # define POSIX_SPAWN_USEVFORK		0x40
 # define POSIX_SPAWN_SETSID		0x80
 # define POSIX_SPAWN_TCSETPGROUP	0x100
+# define POSIX_SPAWN_SETCGROUP		0x200
+# define POSIX_SPAWN_CLONE_PARENT	0x400
+# define POSIX_SPAWN_SETAFFINITY	0x800
 #endif
 
 
@@ -179,6 +186,28 @@ extern int posix_spawnattr_tcsetpgrp_np (posix_spawnattr_t *__attr, int fd)
 extern int posix_spawnattr_tcgetpgrp_np (const posix_spawnattr_t *
 					 __restrict __attr, int *fd)
      __THROW __nonnull ((1, 2));
+
+/* Have the spawn call store a pidfd referring to the new process in
+   *PIDFD, or -1 if the kernel cannot create one.  The pidfd is created
+   along with the process, so it cannot refer to a reused pid, and it
+   is close-on-exec.  A null PIDFD turns this off.  */
+extern int posix_spawnattr_setpidfd_np (posix_spawnattr_t *__attr,
+					int *__pidfd)
+     __THROW __nonnull ((1));
+
+/* Create the spawned process in the cgroup (v2) whose directory is
+   open as CGROUP, if POSIX_SPAWN_SETCGROUP is set.  */
+extern int posix_spawnattr_setcgroup_np (posix_spawnattr_t *__attr,
+					 int __cgroup)
+     __THROW __nonnull ((1));
+
+/* Restrict the spawned process to the CPUs in CPUSET, of CPUSETSIZE
+   bytes, if POSIX_SPAWN_SETAFFINITY is set.  CPUSET is not copied and
+   must remain valid until the spawn call returns.  */
+extern int posix_spawnattr_setaffinity_np (posix_spawnattr_t *__attr,
+					   size_t __cpusetsize,
+					   const cpu_set_t *__cpuset)
+     __THROW __nonnull ((1));
 #endif
 
 /* Initialize data structure for file attribute for `spawn' call.  */
@@ -227,6 +256,21 @@ extern int posix_spawn_file_actions_addchdir_np (posix_spawn_file_actions_t *
 extern int posix_spawn_file_actions_addfchdir_np (posix_spawn_file_actions_t *,
 						  int __fd)
      __THROW __nonnull ((1));
+
+/* Add an action closing all file descriptors greater than or equal to
+   FROM during spawn.  This affects the subsequent file actions.  */
+extern int
+posix_spawn_file_actions_addclosefrom_np (posix_spawn_file_actions_t *,
+					  int __from)
+     __THROW __nonnull ((1));
+
+/* Make the dup2 action at position INDEX of FILE-ACTIONS, counting
+   from 0 in the order the actions were added, duplicate FD instead
+   of the descriptor it was added with.  */
+extern int
+posix_spawn_file_actions_setdup2_np (posix_spawn_file_actions_t *,
+				     int __index, int __fd)
+     __THROW __nonnull ((1));
 #endif
 
 __END_DECLS
@@ -0,0 +1,42 @@
+/* Add a closefrom action to the file actions of posix_spawn.
+
+   This file is not part of the GNU C Library.  It provides the
+   posix_spawn_file_actions_addclosefrom_np interface of glibc 2.34
+   on top of the file actions that glibc's other functions create, so
+   it must grow the action array the same way they do.  */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "spawn_int.h"
+
+int
+posix_spawn_file_actions_addclosefrom_np (posix_spawn_file_actions_t *
+					  file_actions, int from)
+{
+  struct __spawn_action *rec;
+  long int maxfd = sysconf (_SC_OPEN_MAX);
+
+  if (from < 0 || (maxfd >= 0 && from >= maxfd))
+    return EBADF;
+
+  /* Allocate more memory if needed, in steps of 8 like glibc.  */
+  if (file_actions->__used == file_actions->__allocated)
+    {
+      int newalloc = file_actions->__allocated + 8;
+      void *newmem = realloc (file_actions->__actions,
+			      newalloc * sizeof (struct __spawn_action));
+      if (newmem == NULL)
+	return ENOMEM;
+      file_actions->__actions = newmem;
+      file_actions->__allocated = newalloc;
+    }
+
+  rec = &file_actions->__actions[file_actions->__used];
+  rec->tag = spawn_do_closefrom;
+  rec->action.closefrom_action.from = from;
+  ++file_actions->__used;
+
+  return 0;
+}
@@ -0,0 +1,29 @@
+/* Change the source of a dup2 action in the file actions of posix_spawn.
+
+   This file is not part of the GNU C Library.  It lets a caller build
+   file actions once and reuse them for many spawns whose pipe ends
+   differ, instead of building them anew for each spawn.  */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include "spawn_int.h"
+
+int
+posix_spawn_file_actions_setdup2_np (posix_spawn_file_actions_t *
+				     file_actions, int index, int fd)
+{
+  struct __spawn_action *rec;
+
+  if (index < 0 || index >= file_actions->__used)
+    return EINVAL;
+
+  rec = &file_actions->__actions[index];
+  if (rec->tag != spawn_do_dup2)
+    return EINVAL;
+
+  if (fd < 0)
+    return EBADF;
+
+  rec->action.dup2_action.fd = fd;
+  return 0;
+}
@@ -0,0 +1,16 @@
+/* Set the CPU affinity option.
+
+   This file is not part of the GNU C Library.  It is an extension
+   of libspawn in the style of posix_spawnattr_tcsetpgrp_np.  */
+
+#define _GNU_SOURCE
+#include <spawn.h>
+
+int
+posix_spawnattr_setaffinity_np (posix_spawnattr_t *attr, size_t cpusetsize,
+				const cpu_set_t *cpuset)
+{
+  attr->__affinity = cpuset;
+  attr->__affinitysize = cpusetsize;
+  return 0;
+}
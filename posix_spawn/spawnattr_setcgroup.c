@@ -0,0 +1,13 @@
+/* Set the cgroup option.
+
+   This file is not part of the GNU C Library.  It is an extension
+   of libspawn in the style of posix_spawnattr_tcsetpgrp_np.  */
+
+#include <spawn.h>
+
+int
+posix_spawnattr_setcgroup_np (posix_spawnattr_t *attr, int cgroup)
+{
+  attr->__cgroup = cgroup;
+  return 0;
+}
@@ -0,0 +1,13 @@
+/* Request a pidfd for the spawned process.
+
+   This file is not part of the GNU C Library.  It is an extension
+   of libspawn in the style of posix_spawnattr_tcsetpgrp_np.  */
+
+#include <spawn.h>
+
+int
+posix_spawnattr_setpidfd_np (posix_spawnattr_t *attr, int *pidfd)
+{
+  attr->__pidfd = pidfd;
+  return 0;
+}
@@ -0,0 +1,29 @@
+/* Store scheduling policy in the attribute structure.
+
+   This file is not part of the GNU C Library.  It replaces glibc's
+   posix_spawnattr_setschedpolicy, which only accepts the POSIX
+   policies, so that SCHED_BATCH and SCHED_IDLE can be used too.  */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <sched.h>
+#include <spawn.h>
+
+int
+posix_spawnattr_setschedpolicy (posix_spawnattr_t *attr, int policy)
+{
+  switch (policy)
+    {
+    case SCHED_OTHER:
+    case SCHED_FIFO:
+    case SCHED_RR:
+    case SCHED_BATCH:
+    case SCHED_IDLE:
+      break;
+    default:
+      return EINVAL;
+    }
+
+  attr->__policy = policy;
+  return 0;
+}
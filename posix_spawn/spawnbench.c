@@ -0,0 +1,118 @@
+/*
+ * Spawn rate microbenchmark.
+ *
+ * Repeatedly spawns a short pipeline the way cush does, i.e., with
+ * posix_spawnp, a pipe between stages and all stages in one process
+ * group, waits for it, and reports pipelines and processes spawned
+ * per second.  Only the time spent in posix_spawnp is counted, so
+ * the result is not dominated by how long the commands run.
+ *
+ * Usage: spawnbench [-n pipelines] [-s stages] [-x] [command]
+ *
+ * With -x, the command is one that does not exist.  The child then
+ * fails in execve() right away, so nearly all of the time measured
+ * is the cost of creating the child and its stack, which is what
+ * the stack pool reduces.  Otherwise, the time the kernel needs to
+ * exec 'command' (default: true) dominates.
+ *
+ * 'make bench' runs it against libspawn with and without the child
+ * stack pool.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/wait.h>
+#include "spawn.h"
+
+extern char **environ;
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int
+main(int ac, char *av[])
+{
+    int npipelines = 2000, nstages = 3, opt;
+    bool failing = false;
+    while ((opt = getopt(ac, av, "n:s:x")) != -1) {
+        switch (opt) {
+        case 'n':
+            npipelines = atoi(optarg);
+            break;
+        case 's':
+            nstages = atoi(optarg);
+            break;
+        case 'x':
+            failing = true;
+            break;
+        default:
+            fprintf(stderr, "Usage: %s [-n pipelines] [-s stages] [-x] "
+                    "[command]\n", av[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    char *argv[] = { optind < ac ? av[optind] : "true", NULL };
+    if (failing)
+        argv[0] = "/nonexistent/command";
+
+    double spawning = 0;
+    for (int p = 0; p < npipelines; p++) {
+        pid_t pgid = 0;
+        int prev = -1;
+        for (int s = 0; s < nstages; s++) {
+            int fds[2] = { -1, -1 };
+            if (s < nstages - 1 && pipe2(fds, O_CLOEXEC) == -1) {
+                perror("pipe2");
+                return EXIT_FAILURE;
+            }
+
+            posix_spawn_file_actions_t fa;
+            posix_spawnattr_t attr;
+            posix_spawn_file_actions_init(&fa);
+            posix_spawnattr_init(&attr);
+            posix_spawnattr_setpgroup(&attr, pgid);
+            posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);
+            if (prev != -1)
+                posix_spawn_file_actions_adddup2(&fa, prev, 0);
+            if (fds[1] != -1)
+                posix_spawn_file_actions_adddup2(&fa, fds[1], 1);
+
+            pid_t pid;
+            double start = now();
+            int rc = posix_spawnp(&pid, argv[0], &fa, &attr, argv, environ);
+            spawning += now() - start;
+            if (rc != 0 && !failing) {
+                fprintf(stderr, "posix_spawnp %s failed: error %d\n",
+                        argv[0], rc);
+                return EXIT_FAILURE;
+            }
+            if (rc == 0 && pgid == 0)
+                pgid = pid;
+
+            posix_spawn_file_actions_destroy(&fa);
+            posix_spawnattr_destroy(&attr);
+            if (prev != -1)
+                close(prev);
+            if (fds[1] != -1)
+                close(fds[1]);
+            prev = fds[0];
+        }
+        while (pgid != 0 && waitpid(-pgid, NULL, 0) > 0)
+            ;
+    }
+
+    printf("%d pipelines of %d stages: %.1f us per spawn, "
+           "%.0f pipelines/s, %.0f spawns/s\n",
+           npipelines, nstages, spawning / npipelines / nstages * 1e6,
+           npipelines / spawning, npipelines * nstages / spawning);
+    return EXIT_SUCCESS;
+}
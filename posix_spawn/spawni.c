@@ -26,6 +26,7 @@
 #include <sys/wait.h>
 #include <sys/param.h>
 #include <sys/mman.h>
+#include <sys/syscall.h>
 //#include <not-cancel.h>
 //#include <local-setxid.h>
 //#include <shlib-compat.h>
@@ -40,6 +41,8 @@
 #include <signal.h>
 #include <pthread.h>
 #include <unistd.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #define __pthread_setcancelstate pthread_setcancelstate
 #define __setpgid setpgid
 #define __getpgrp getpgrp
@@ -160,6 +163,7 @@ struct posix_spawn_args
   ptrdiff_t argc;
   char *const *envp;
   int xflags;
+  int cgroup;			/* cgroup the child must move itself to, or -1 */
   int err;
 };
 
@@ -188,6 +192,29 @@ maybe_script_execute (struct posix_spawn_args *args)
     }
 }
 
+/* Close all file descriptors from LOWFD up with a single close_range
+   call.  On kernels without it (before 5.9), close them one by one up
+   to the RLIMIT_NOFILE soft limit, or the kernel's default maximum if
+   there is none.  */
+static int
+spawn_closefrom (int lowfd)
+{
+#ifdef SYS_close_range
+  if (syscall (SYS_close_range, (unsigned int) lowfd, ~0U, 0) == 0)
+    return 0;
+  if (errno != ENOSYS)
+    return -1;
+#endif
+  struct rlimit64 fdlimit;
+  if (__getrlimit64 (RLIMIT_NOFILE, &fdlimit) != 0)
+    return -1;
+  if (fdlimit.rlim_cur == RLIM64_INFINITY)
+    fdlimit.rlim_cur = 1024 * 1024;
+  for (rlim64_t fd = lowfd; fd < fdlimit.rlim_cur; fd++)
+    __close_nocancel (fd);
+  return 0;
+}
+
 /* Function used in the clone call to setup the signals mask, posix_spawn
    attributes, and file actions.  It run on its own stack (provided by the
    posix_spawn call).  */
@@ -269,6 +296,23 @@ __spawni_child (void *arguments)
 	goto fail;
     }
 
+  /* Set the CPU affinity.  */
+  if ((attr->__flags & POSIX_SPAWN_SETAFFINITY) != 0
+      && sched_setaffinity (0, attr->__affinitysize, attr->__affinity) != 0)
+    goto fail;
+
+  /* Move into the requested cgroup, unless clone3 already placed the
+     child there.  Writing "0" to cgroup.procs moves the writer.  */
+  if (args->cgroup >= 0)
+    {
+      int fd = openat (args->cgroup, "cgroup.procs", O_WRONLY | O_CLOEXEC);
+      if (fd == -1)
+	goto fail;
+      if (write (fd, "0", 1) != 1)
+	goto fail;
+      __close_nocancel (fd);
+    }
+
   /* Set the effective user and group IDs.  */
   if ((attr->__flags & POSIX_SPAWN_RESETIDS) != 0
       && (local_seteuid (__getuid ()) != 0
@@ -365,6 +409,11 @@ __spawni_child (void *arguments)
 	      if (__fchdir (action->action.fchdir_action.fd) != 0)
 		goto fail;
 	      break;
+
+	    case spawn_do_closefrom:
+	      if (spawn_closefrom (action->action.closefrom_action.from) != 0)
+		goto fail;
+	      break;
 	    }
 	}
     }
@@ -391,6 +440,178 @@ fail:
   _exit (SPAWN_ERROR);
 }
 
+#ifndef SPAWN_NO_STACK_POOL
+/* Child stacks are taken from a small pool instead of being mapped and
+   unmapped for every spawn, which costs two VM syscalls plus the page
+   faults of touching a fresh stack.  The stacks are populated when
+   they are first mapped and are never unmapped.  The pool is only
+   used if the stack required for ARGV fits into SPAWN_POOL_STACK_SIZE;
+   if all of its stacks are in use by other threads, or for larger
+   argument vectors, a stack is mapped as before.
+
+   Since the parent is suspended (CLONE_VFORK) until the child has
+   exec'ed or exited, a stack is free again as soon as clone returns.  */
+# define SPAWN_POOL_STACKS	4
+# define SPAWN_POOL_STACK_SIZE	(64 * 1024)
+
+static void *spawn_pool_stack[SPAWN_POOL_STACKS];
+static atomic_bool spawn_pool_busy[SPAWN_POOL_STACKS];
+
+/* Return a pooled stack of at least *STACK_SIZE bytes and set
+   *STACK_SIZE to its actual size, or return NULL.  */
+static void *
+spawn_pool_get (size_t *stack_size, int prot)
+{
+  if (*stack_size > SPAWN_POOL_STACK_SIZE)
+    return NULL;
+
+  for (int i = 0; i < SPAWN_POOL_STACKS; i++)
+    {
+      if (atomic_exchange_explicit (&spawn_pool_busy[i], true,
+				    memory_order_acquire))
+	continue;
+
+      if (spawn_pool_stack[i] == NULL)
+	{
+	  void *stack = __mmap (NULL, SPAWN_POOL_STACK_SIZE, prot,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK
+				| MAP_POPULATE, -1, 0);
+	  if (stack == MAP_FAILED)
+	    {
+	      atomic_store_explicit (&spawn_pool_busy[i], false,
+				     memory_order_release);
+	      return NULL;
+	    }
+	  spawn_pool_stack[i] = stack;
+	}
+      *stack_size = SPAWN_POOL_STACK_SIZE;
+      return spawn_pool_stack[i];
+    }
+  return NULL;
+}
+
+/* Release STACK, returning true if it belongs to the pool.  */
+static bool
+spawn_pool_put (void *stack)
+{
+  for (int i = 0; i < SPAWN_POOL_STACKS; i++)
+    if (spawn_pool_stack[i] == stack)
+      {
+	atomic_store_explicit (&spawn_pool_busy[i], false,
+			       memory_order_release);
+	return true;
+      }
+  return false;
+}
+#else
+# define spawn_pool_get(stack_size, prot) NULL
+# define spawn_pool_put(stack) false
+#endif
+
+#ifndef CLONE_INTO_CGROUP
+# define CLONE_INTO_CGROUP 0x200000000ULL
+#endif
+
+/* Argument of the clone3 system call, as in <linux/sched.h>  */
+struct spawn_clone_args
+{
+  uint64_t flags;
+  uint64_t pidfd;
+  uint64_t child_tid;
+  uint64_t parent_tid;
+  uint64_t exit_signal;
+  uint64_t stack;
+  uint64_t stack_size;
+  uint64_t tls;
+  uint64_t set_tid;
+  uint64_t set_tid_size;
+  uint64_t cgroup;
+};
+
+#ifdef __x86_64__
+/* Invoke clone3 with CL_ARGS and run FN (ARG) in the child, which then
+   exits with its return value.  Unlike with clone, the child resumes
+   on its own stack right after the system call instruction, so this
+   must be done in assembly.  Returns the child's pid, or a negative
+   error number.  */
+extern long __spawn_clone3 (struct spawn_clone_args *cl_args, size_t size,
+			    int (*fn) (void *), void *arg) attribute_hidden;
+__asm__ (
+"	.text\n"
+"	.globl	__spawn_clone3\n"
+"	.hidden	__spawn_clone3\n"
+"	.type	__spawn_clone3, @function\n"
+"__spawn_clone3:\n"
+"	movq	%rdx, %r8\n"		/* fn and arg survive the syscall */
+"	movq	%rcx, %r9\n"
+"	movl	$435, %eax\n"		/* __NR_clone3 */
+"	syscall\n"
+"	testq	%rax, %rax\n"
+"	jnz	1f\n"
+"	xorl	%ebp, %ebp\n"		/* child: outermost frame */
+"	movq	%r9, %rdi\n"
+"	call	*%r8\n"
+"	movl	%eax, %edi\n"
+"	movl	$60, %eax\n"		/* __NR_exit */
+"	syscall\n"
+"	hlt\n"
+"1:	ret\n"
+"	.size	__spawn_clone3, .-__spawn_clone3\n");
+
+/* Set once the kernel has turned out not to support clone3, or not
+   CLONE_INTO_CGROUP.  */
+static atomic_bool spawn_no_clone3;
+#endif
+
+/* Create the child of a spawn that asked for a pidfd (if PIDFD) or a
+   target cgroup (if CGROUP >= 0).  clone3 creates the pidfd and places
+   the child into the cgroup atomically.  Without it, clone with
+   CLONE_PIDFD (Linux 5.2) is used, and the child moves itself into
+   the cgroup.  Without that either, *PIDFD is set to -1.  FLAGS are
+   additional clone flags.
+
+   Returns the child's pid, or a negative error number.  */
+static pid_t
+spawn_clone_ext (struct posix_spawn_args *args, void *stack,
+		 size_t stack_size, int *pidfd, int cgroup, int flags)
+{
+  *pidfd = -1;
+#ifdef __x86_64__
+  if (!atomic_load_explicit (&spawn_no_clone3, memory_order_relaxed))
+    {
+      struct spawn_clone_args cl_args = {
+	.flags = CLONE_VM | CLONE_VFORK | CLONE_PIDFD | flags
+		 | (cgroup >= 0 ? CLONE_INTO_CGROUP : 0),
+	.pidfd = (uintptr_t) pidfd,
+	/* With CLONE_PARENT, the caller's own exit signal is used.  */
+	.exit_signal = (flags & CLONE_PARENT) ? 0 : SIGCHLD,
+	.stack = (uintptr_t) stack,
+	.stack_size = stack_size,
+	.cgroup = cgroup >= 0 ? cgroup : 0,
+      };
+      long ret = __spawn_clone3 (&cl_args, sizeof cl_args,
+				 __spawni_child, args);
+      /* ENOSYS: no clone3.  E2BIG: a kernel that predates the cgroup
+	 field, which must then be zero.  */
+      if (ret != -ENOSYS && ret != -E2BIG)
+	return ret;
+      atomic_store_explicit (&spawn_no_clone3, true, memory_order_relaxed);
+    }
+#endif
+
+  args->cgroup = cgroup;
+  pid_t pid = __clone (__spawni_child, STACK (stack, stack_size),
+		       CLONE_VM | CLONE_VFORK | CLONE_PIDFD | flags | SIGCHLD,
+		       args, pidfd);
+  if (pid == -1 && errno == EINVAL)
+    {
+      *pidfd = -1;
+      pid = __clone (__spawni_child, STACK (stack, stack_size),
+		     CLONE_VM | CLONE_VFORK | flags | SIGCHLD, args);
+    }
+  return pid == -1 ? -errno : pid;
+}
+
 /* Spawn a new process executing PATH with the attributes describes in *ATTRP.
    Before running the process perform the actions described in FILE-ACTIONS. */
 static int
@@ -432,10 +653,14 @@ __spawnix (pid_t * pid, const char *file,
      extra pages won't actually be allocated unless they get used.  */
   argv_size += (32 * 1024);
   size_t stack_size = ALIGN_UP (argv_size, GLRO(dl_pagesize));
-  void *stack = __mmap (NULL, stack_size, prot,
-			MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
-  if (__glibc_unlikely (stack == MAP_FAILED))
-    return errno;
+  void *stack = spawn_pool_get (&stack_size, prot);
+  if (stack == NULL)
+    {
+      stack = __mmap (NULL, stack_size, prot,
+		      MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+      if (__glibc_unlikely (stack == MAP_FAILED))
+	return errno;
+    }
 
   /* Disable asynchronous cancellation.  */
   int state;
@@ -452,6 +677,7 @@ __spawnix (pid_t * pid, const char *file,
   args.argc = argc;
   args.envp = envp;
   args.xflags = xflags;
+  args.cgroup = -1;
 
   __libc_signal_block_all (&args.oldmask);
 
@@ -463,8 +689,19 @@ __spawnix (pid_t * pid, const char *file,
      need for CLONE_SETTLS.  Although parent and child share the same TLS
      namespace, there will be no concurrent access for TLS variables (errno
      for instance).  */
-  new_pid = CLONE (__spawni_child, STACK (stack, stack_size), stack_size,
-		   CLONE_VM | CLONE_VFORK | SIGCHLD, &args);
+  int pidfd = -1;
+  int cgroup = (args.attr->__flags & POSIX_SPAWN_SETCGROUP)
+	       ? args.attr->__cgroup : -1;
+  /* With CLONE_PARENT, the child becomes a sibling rather than a child
+     of the caller, so only the caller's parent can wait for it.  */
+  int clone_parent = (args.attr->__flags & POSIX_SPAWN_CLONE_PARENT)
+		     ? CLONE_PARENT : 0;
+  if (args.attr->__pidfd != NULL || cgroup >= 0)
+    new_pid = spawn_clone_ext (&args, stack, stack_size, &pidfd, cgroup,
+			       clone_parent);
+  else
+    new_pid = CLONE (__spawni_child, STACK (stack, stack_size), stack_size,
+		     CLONE_VM | CLONE_VFORK | clone_parent | SIGCHLD, &args);
 
   /* It needs to collect the case where the auxiliary process was created
      but failed to execute the file (due either any preparation step or
@@ -478,7 +715,7 @@ __spawnix (pid_t * pid, const char *file,
 	 due a signal args.err will remain zeroed and it will be up to
 	 caller to actually collect it.  */
       ec = args.err;
-      if (ec > 0)
+      if (ec > 0 && !clone_parent)
 	/* There still an unlikely case where the child is cancelled after
 	   setting args.err, due to a positive error value.  Also there is
 	   possible pid reuse race (where the kernel allocated the same pid
@@ -490,11 +727,24 @@ __spawnix (pid_t * pid, const char *file,
   else
     ec = -new_pid;
 
-  __munmap (stack, stack_size);
+  if (!spawn_pool_put (stack))
+    __munmap (stack, stack_size);
 
-  if ((ec == 0) && (pid != NULL))
+  /* A failed child that the caller could not collect is reported,
+     so that whoever can is able to.  */
+  if ((ec == 0 || (clone_parent && new_pid > 0)) && (pid != NULL))
     *pid = new_pid;
 
+  if (ec != 0 && pidfd != -1)
+    {
+      __close_nocancel (pidfd);
+      pidfd = -1;
+    }
+  if (args.attr->__pidfd != NULL)
+    *args.attr->__pidfd = pidfd;
+  else if (pidfd != -1)
+    __close_nocancel (pidfd);
+
   __libc_signal_restore_set (&args.oldmask);
 
   __pthread_setcancelstate (state, NULL);
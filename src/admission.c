@@ -0,0 +1,104 @@
+/*
+ * Limits on running background jobs, and the load and pressure
+ * thresholds that queued jobs wait for.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "admission.h"
+
+/* How often the load and pressure are checked while jobs are queued */
+#define ADMISSION_RECHECK_MS 1000
+
+static int max_running;         /* 0 for no limit */
+static double max_load;         /* 1-minute load average, 0 for none */
+static double max_cpu_pressure; /* PSI "some" avg10 in percent, 0 for none */
+
+bool
+admission_parse(char **argv)
+{
+    int newmax = max_running;
+    double newload = max_load, newpressure = max_cpu_pressure;
+
+    for (; *argv != NULL; argv++) {
+        char *end;
+        if (strcmp(*argv, "off") == 0) {
+            newmax = 0;
+            newload = newpressure = 0;
+        } else if (strncmp(*argv, "load=", 5) == 0) {
+            newload = strtod(*argv + 5, &end);
+            if (end == *argv + 5 || *end != '\0' || newload < 0)
+                return false;
+        } else if (strncmp(*argv, "cpu=", 4) == 0) {
+            newpressure = strtod(*argv + 4, &end);
+            if (end == *argv + 4 || strcmp(end, "%") != 0
+                || newpressure < 0 || newpressure > 100)
+                return false;
+        } else {
+            long n = strtol(*argv, &end, 10);
+            if (end == *argv || *end != '\0' || n < 0 || n > 1000000)
+                return false;
+            newmax = n;
+        }
+    }
+    max_running = newmax;
+    max_load = newload;
+    max_cpu_pressure = newpressure;
+    return true;
+}
+
+void
+admission_print(void)
+{
+    printf("bglimit:");
+    if (max_running == 0 && max_load == 0 && max_cpu_pressure == 0)
+        printf(" off");
+    if (max_running > 0)
+        printf(" %d running", max_running);
+    if (max_load > 0)
+        printf(" load=%.2f", max_load);
+    if (max_cpu_pressure > 0)
+        printf(" cpu=%.2f%%", max_cpu_pressure);
+    printf("\n");
+}
+
+/* Return the "some" avg10 of /proc/pressure/cpu, or 0 if the kernel
+ * does not track pressure */
+static double
+cpu_pressure(void)
+{
+    double some = 0;
+    FILE *f = fopen("/proc/pressure/cpu", "r");
+    if (f != NULL) {
+        if (fscanf(f, "some avg10=%lf", &some) != 1)
+            some = 0;
+        fclose(f);
+    }
+    return some;
+}
+
+bool
+admission_allows(int running)
+{
+    if (max_running > 0 && running >= max_running)
+        return false;
+
+    //With nothing running, the thresholds could only be met because
+    //of other work, which the shell cannot wait out; start the job
+    if (running == 0)
+        return true;
+
+    double load;
+    if (max_load > 0 && getloadavg(&load, 1) == 1 && load >= max_load)
+        return false;
+    if (max_cpu_pressure > 0 && cpu_pressure() >= max_cpu_pressure)
+        return false;
+    return true;
+}
+
+int
+admission_recheck_timeout(void)
+{
+    return max_load > 0 || max_cpu_pressure > 0 ? ADMISSION_RECHECK_MS : -1;
+}
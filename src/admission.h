@@ -0,0 +1,31 @@
+#ifndef __ADMISSION_H
+#define __ADMISSION_H
+
+#include <stdbool.h>
+
+/*
+ * Admission control for background jobs.
+ *
+ * At most a given number of background jobs run at a time; jobs
+ * started beyond that are queued and spawned in order as running ones
+ * finish.  Optionally, queued jobs also wait until the load average
+ * and/or the system's CPU pressure (PSI) are below a threshold.
+ */
+
+/* Set the limits from the arguments of the bglimit builtin, i.e.
+ * [N|off] [load=L] [cpu=P%].  Returns false if they are invalid. */
+bool admission_parse(char **argv);
+
+/* Print the limits */
+void admission_print(void);
+
+/* Return true if another background job may be spawned while
+ * 'running' of them are running */
+bool admission_allows(int running);
+
+/* Return how many milliseconds queued jobs should wait before the
+ * load and pressure are checked again, or -1 if only a finished job
+ * can let them start */
+int admission_recheck_timeout(void);
+
+#endif /* __ADMISSION_H */
@@ -0,0 +1,82 @@
+#!/usr/bin/python
+#
+# Tests the after builtin: pending jobs are listed with their
+# dependencies and started, or cancelled, when those are done.
+#
+import atexit, proc_check, time
+from testutils import *
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+sendline("after %42 -- echo never")
+expect_exact("no such job", "after accepted a job that does not exist")
+expect_prompt()
+
+sendline("after")
+expect_exact("usage", "after accepted a missing pipeline")
+expect_prompt()
+
+sendline("sleep 2 &")
+(good, pid) = parse_bg_status()
+expect_prompt()
+sendline("sleep 2 | false &")
+(bad, pid) = parse_bg_status()
+expect_prompt()
+
+sendline("after %%%s -- echo first" % good)
+(first,) = parse_regular_expression(console, r"\[(\d+)\] pending")
+expect_prompt()
+sendline("after %%%s %%%s -- echo second" % (good, bad))
+(second,) = parse_regular_expression(console, r"\[(\d+)\] pending")
+expect_prompt()
+sendline("after --always %%%s -- echo third" % bad)
+(third,) = parse_regular_expression(console, r"\[(\d+)\] pending")
+expect_prompt()
+
+sendline("jobs")
+expect(r"\[%s\]\s+Pending\s+\(echo first\) after %%%s\r\n" % (first, good),
+       "first job is not pending")
+expect(r"\[%s\]\s+Pending\s+\(echo second\) after %%%s %%%s\r\n"
+       % (second, good, bad), "second job is not pending")
+expect(r"\[%s\]\s+Pending\s+\(echo third\) after %%%s\r\n" % (third, bad),
+       "third job is not pending")
+expect_prompt()
+
+# the prompt is not blocked while jobs are pending
+sendline("echo ready")
+expect_exact("ready\r\n", "the shell did not run a command while jobs were pending")
+expect_prompt()
+
+# the first one runs on success, the second is cancelled since one
+# of its dependencies failed, the third runs regardless
+expect_exact("first", "first job did not run")
+expect(r"\[%s\]\s+Cancelled" % second, "second job was not cancelled")
+expect_exact("third", "third job did not run")
+
+# killing a pending job cancels the jobs pending on it
+sendline("sleep 30 &")
+(long, pid) = parse_bg_status()
+expect_prompt()
+sendline("after %%%s -- echo fourth" % long)
+(fourth,) = parse_regular_expression(console, r"\[(\d+)\] pending")
+expect_prompt()
+sendline("after %%%s -- echo fifth" % fourth)
+(fifth,) = parse_regular_expression(console, r"\[(\d+)\] pending")
+expect_prompt()
+run_builtin("kill", fourth)
+expect(r"\[%s\]\s+Cancelled" % fifth, "fifth job was not cancelled")
+expect_prompt()
+
+run_builtin("kill", long)
+expect_exact("Terminated", "killed job was not reported")
+expect_prompt()
+# let readline redraw its line after the notice before typing again
+time.sleep(0.5)
+
+sendline("exit")
+expect_exact("exit\r\n", "Shell output extraneous characters")
+
+test_success()
@@ -0,0 +1,36 @@
+#!/usr/bin/python
+#
+# Tests that the bench builtin runs a pipeline repeatedly and reports
+# the distribution of its wall clock times.
+#
+import atexit, proc_check, time
+from testutils import *
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+# 5 measured runs after 2 warmup runs; the pipeline writes a file
+# so we can count how often it ran
+sendline("bench -n 5 -w 2 echo run >> bench-test.txt")
+expect(r"5 runs, 2 warmup", "number of runs not reported")
+expect(r"wall\s+min \d+\.\d{3}ms median \d+\.\d{3}ms p90 \d+\.\d{3}ms"
+       r" p99 \d+\.\d{3}ms max \d+\.\d{3}ms", "wall clock times not reported")
+expect(r"cpu\s+user \d+\.\d{3}s sys \d+\.\d{3}s", "CPU time not reported")
+expect_prompt()
+
+runs = open("bench-test.txt").read().count("run")
+os.remove("bench-test.txt")
+assert runs == 7, "pipeline ran %d times instead of 7" % runs
+
+# the runs do not linger as jobs
+sendline("jobs")
+expect_exact("jobs\r\n")
+expect_prompt("runs still listed as jobs")
+assert "echo" not in console.before, "runs still listed as jobs"
+
+sendline("exit")
+expect_exact("exit\r\n", "Shell output extraneous characters")
+
+test_success()
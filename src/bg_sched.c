@@ -0,0 +1,164 @@
+/*
+ * Scheduling class and nice value of background jobs.
+ *
+ * The nice value is per process and can be set for a process group
+ * at once.  The scheduling class is per thread, so changing it for a
+ * job that is already running means going through the threads of each
+ * of its processes under /proc/<pid>/task.  The shell passes the
+ * processes it spawned for the job rather than have all of /proc
+ * searched for the members of the group.
+ */
+#define _GNU_SOURCE    1
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sched.h>
+#include <sys/resource.h>
+
+#include "bg_sched.h"
+#include "utils.h"
+
+static int policy = -1;         /* Class of background jobs, -1 if the shell's */
+static int nice_offset;         /* Added to the shell's nice value */
+
+static bool ever_set;           /* Jobs may have been lowered */
+static bool shell_sched_known;
+static int shell_policy;        /* The shell's own class and nice value, */
+static int shell_nice;          /* which foreground jobs run with */
+
+static void
+get_shell_sched(void)
+{
+    if (shell_sched_known)
+        return;
+    shell_policy = sched_getscheduler(0);
+    if (shell_policy == -1)
+        shell_policy = SCHED_OTHER;
+    errno = 0;
+    shell_nice = getpriority(PRIO_PROCESS, 0);
+    if (shell_nice == -1 && errno != 0)
+        shell_nice = 0;
+    shell_sched_known = true;
+}
+
+bool
+bg_sched_parse(char **argv)
+{
+    int newpolicy = policy, newoffset = nice_offset;
+
+    for (; *argv != NULL; argv++) {
+        if (strcmp(*argv, "off") == 0) {
+            newpolicy = -1;
+            newoffset = 0;
+        } else if (strcmp(*argv, "batch") == 0)
+            newpolicy = SCHED_BATCH;
+        else if (strcmp(*argv, "idle") == 0)
+            newpolicy = SCHED_IDLE;
+        else if (strcmp(*argv, "nice") == 0 && argv[1] != NULL) {
+            char *end;
+            long n = strtol(*++argv, &end, 10);
+            if (*end != '\0' || n < 0 || n > 39)
+                return false;
+            newoffset = n;
+        } else
+            return false;
+    }
+    get_shell_sched();
+    ever_set |= newpolicy != -1 || newoffset != 0;
+    policy = newpolicy;
+    nice_offset = newoffset;
+    return true;
+}
+
+void
+bg_sched_print(void)
+{
+    const char *name = policy == SCHED_BATCH ? "batch"
+                     : policy == SCHED_IDLE ? "idle" : "off";
+    printf("bgsched: %s nice %d\n", name, nice_offset);
+}
+
+int
+bg_sched_policy(void)
+{
+    return policy;
+}
+
+/* Return the nice value of background jobs */
+static int
+bg_nice(void)
+{
+    int n = shell_nice + nice_offset;
+    return n > 19 ? 19 : n;
+}
+
+void
+bg_sched_renice(pid_t pgid)
+{
+    if (nice_offset != 0 && setpriority(PRIO_PGRP, pgid, bg_nice()) == -1
+        && errno != ESRCH)
+        utils_error("cannot renice process group %d: ", pgid);
+}
+
+/* Set the class of every thread of the 'npids' processes 'pids' of
+ * process group 'pgid'.  Processes that exit meanwhile are skipped. */
+static void
+set_pgrp_policy(pid_t pgid, const pid_t *pids, int npids, int newpolicy)
+{
+    struct sched_param param = { .sched_priority = 0 };
+    int error = 0;
+    for (int i = 0; i < npids; i++) {
+        char path[64];
+        snprintf(path, sizeof path, "/proc/%d/task", pids[i]);
+        DIR *tasks = opendir(path);
+        if (tasks == NULL)
+            continue;
+        struct dirent *t;
+        while ((t = readdir(tasks)) != NULL) {
+            int tid = atoi(t->d_name);
+            if (tid > 0 && sched_setscheduler(tid, newpolicy, &param) == -1
+                && errno != ESRCH)
+                error = errno;
+        }
+        closedir(tasks);
+    }
+    if (error != 0) {
+        errno = error;
+        utils_error("cannot change scheduling class of process group %d: ",
+                    pgid);
+    }
+}
+
+void
+bg_sched_lower(pid_t pgid, const pid_t *pids, int npids)
+{
+    if (policy != -1)
+        set_pgrp_policy(pgid, pids, npids, policy);
+    bg_sched_renice(pgid);
+}
+
+bool
+bg_sched_raise(pid_t pgid, const pid_t *pids, int npids)
+{
+    static bool noted;
+
+    //The job may have been lowered under an earlier policy
+    if (!ever_set)
+        return true;
+    set_pgrp_policy(pgid, pids, npids, shell_policy);
+    if (setpriority(PRIO_PGRP, pgid, shell_nice) == 0 || errno == ESRCH)
+        return true;
+
+    //Lowering a nice value needs CAP_SYS_NICE or a suitable RLIMIT_NICE,
+    //which is expected to be missing; that is said only once
+    if (errno == EACCES || errno == EPERM) {
+        if (!noted)
+            fprintf(stderr, "bgsched: the shell may not lower nice values, "
+                    "so jobs moved to the foreground stay niced\n");
+        noted = true;
+    } else
+        utils_error("cannot restore nice value of process group %d: ", pgid);
+    return false;
+}
@@ -0,0 +1,44 @@
+#ifndef __BG_SCHED_H
+#define __BG_SCHED_H
+
+#include <sys/types.h>
+#include <stdbool.h>
+
+/*
+ * Scheduling of background jobs.
+ *
+ * Background jobs may be run in a weaker scheduling class than the
+ * shell, SCHED_BATCH or SCHED_IDLE, and/or with a higher nice value,
+ * so that heavy batch work does not slow down the foreground job and
+ * the prompt.  The class is set by posix_spawn() before the stage
+ * execs; the nice value is applied to the job's process group right
+ * after it is spawned.  Moving a job to the foreground restores the
+ * shell's own class and nice value for its processes, and moving it
+ * back to the background lowers them again.
+ */
+
+/* Set the policy from the arguments of the bgsched builtin, i.e.
+ * [off|batch|idle] [nice N].  Returns false if they are invalid. */
+bool bg_sched_parse(char **argv);
+
+/* Print the policy */
+void bg_sched_print(void);
+
+/* Return the scheduling policy background stages are spawned with,
+ * or -1 if they inherit the shell's */
+int bg_sched_policy(void);
+
+/* Apply the background nice value to process group 'pgid' */
+void bg_sched_renice(pid_t pgid);
+
+/* Apply the background nice value to process group 'pgid', and the
+ * background class to its 'npids' processes 'pids' */
+void bg_sched_lower(pid_t pgid, const pid_t *pids, int npids);
+
+/* Give process group 'pgid' the shell's nice value, and its 'npids'
+ * processes 'pids' the shell's class.  Returns false if the group
+ * keeps a higher nice value, as it does if the shell lacks the
+ * privilege to lower it again. */
+bool bg_sched_raise(pid_t pgid, const pid_t *pids, int npids);
+
+#endif /* __BG_SCHED_H */
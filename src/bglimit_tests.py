@@ -0,0 +1,67 @@
+#!/usr/bin/python
+#
+# Tests the bglimit builtin: background jobs beyond the limit are
+# queued, listed as Queued and started in order as others finish.
+#
+import atexit, proc_check, time
+from testutils import *
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+sendline("bglimit")
+expect_exact("bglimit: off", "bglimit did not print the limits")
+expect_prompt()
+
+sendline("bglimit many")
+expect_exact("usage", "bglimit accepted an invalid limit")
+expect_prompt()
+
+sendline("bglimit 1")
+expect_prompt()
+
+sendline("sleep 1 &")
+(first, pid) = parse_bg_status()
+expect_prompt()
+sendline("sleep 30 &")
+(second,) = parse_regular_expression(console, r"\[(\d+)\] queued")
+expect_prompt()
+sendline("sleep 30 &")
+(third,) = parse_regular_expression(console, r"\[(\d+)\] queued")
+expect_prompt()
+
+sendline("jobs")
+expect(r"\[%s\]\s+Running" % first, "first job is not running")
+expect(r"\[%s\]\s+Queued" % second, "second job is not queued")
+expect(r"\[%s\]\s+Queued" % third, "third job is not queued")
+expect_prompt()
+
+# killing a queued job removes it
+run_builtin("kill", third)
+expect_prompt()
+
+# and it is gone, not left for fg to trip over
+run_builtin("fg", third)
+expect_exact("no such job", "fg did not reject a job that is gone")
+expect_prompt()
+
+# once the first job is done, the second one starts
+expect(r"\[%s\]\s+Done" % first, "first job did not finish")
+expect(r"\[%s\] \d+" % second, "second job was not started")
+sendline("jobs")
+expect(r"\[%s\]\s+Running" % second, "second job is not running")
+expect_prompt()
+assert "[%s]" % third not in console.before, "killed job still listed"
+
+run_builtin("kill", second)
+expect_exact("Terminated", "killed job was not reported")
+expect_prompt()
+# let readline redraw its line after the notice before typing again
+time.sleep(0.5)
+
+sendline("exit")
+expect_exact("exit\r\n", "Shell output extraneous characters")
+
+test_success()
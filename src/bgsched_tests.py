@@ -0,0 +1,78 @@
+#!/usr/bin/python
+#
+# Tests the bgsched builtin: background jobs are spawned in SCHED_BATCH
+# with a higher nice value, fg restores the shell's scheduling and bg
+# lowers the job again.
+#
+import atexit, proc_check, time, os
+from testutils import *
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+# policy and nice value of a process, fields 41 and 19 of its stat file
+def sched_of(pid):
+    fields = open("/proc/%s/stat" % pid).read().split(")")[1].split()
+    return (int(fields[38]), int(fields[16]))
+
+SCHED_OTHER = 0
+SCHED_BATCH = 3
+(shell_policy, shell_nice) = sched_of(console.pid)
+
+sendline("bgsched")
+expect_exact("bgsched: off nice 0", "bgsched did not print the policy")
+expect_prompt()
+
+sendline("bgsched sometimes")
+expect_exact("usage", "bgsched accepted an unknown policy")
+expect_prompt()
+
+sendline("bgsched batch nice 5")
+expect_prompt()
+
+sendline("sleep 30 &")
+(jobid, pid) = parse_bg_status()
+expect_prompt()
+assert sched_of(pid) == (SCHED_BATCH, min(shell_nice + 5, 19)), \
+    "background job was not lowered"
+
+# in the foreground, it runs like the shell.  Lowering the nice value
+# again needs privilege, without which the job keeps its nice value.
+run_builtin("fg", jobid)
+proc_check.wait_until_child_is_in_foreground(console)
+if os.geteuid() == 0:
+    assert sched_of(pid) == (shell_policy, shell_nice), \
+        "foreground job was not raised"
+else:
+    assert sched_of(pid)[0] == shell_policy, \
+        "foreground job was not given the shell's class"
+
+# stop it and resume it in the background, which lowers it again
+sendcontrol('z')
+(jobid, status, cmdline) = parse_job_line()
+assert status == 'stopped', "Shell did not report stopped job"
+expect_prompt()
+
+# jobs -l says when the job kept its nice value
+sendline("jobs -l")
+expect_prompt()
+assert ("niced as a background job" in console.before) \
+    == (os.geteuid() != 0), "jobs -l misreported the job's nice value"
+
+run_builtin("bg", jobid)
+expect_prompt()
+assert sched_of(pid) == (SCHED_BATCH, min(shell_nice + 5, 19)), \
+    "job resumed in the background was not lowered"
+
+run_builtin("kill", jobid)
+expect_exact("Terminated", "killed job was not reported")
+expect_prompt()
+# let readline redraw its line after the notice before typing again
+time.sleep(0.5)
+
+sendline("exit")
+expect_exact("exit\r\n", "Shell output extraneous characters")
+
+test_success()
@@ -0,0 +1,81 @@
+#!/usr/bin/python
+#
+# Tests per-job cgroups (cush -c): a job is spawned into its own cgroup
+# under the given directory, its pressure is listed by 'jobs -l', and
+# 'limit' either sets its limits or reports why it cannot.  Without a
+# cgroup v2 directory to delegate, it checks that the shell warns and
+# runs jobs anyway.
+#
+import atexit, proc_check, time, os, testutils
+from testutils import *
+
+# find a cgroup v2 mount in which we may create a directory
+parent = None
+for line in open("/proc/mounts"):
+    fields = line.split()
+    if fields[2] == "cgroup2":
+        candidate = "%s/cush-test-%d" % (fields[1], os.getpid())
+        try:
+            os.mkdir(candidate)
+            parent = candidate
+            atexit.register(lambda: os.path.isdir(candidate)
+                                    and os.rmdir(candidate))
+        except OSError:
+            pass
+        break
+
+if parent is None:
+    console = setup_tests([" -c /nonexistent-cgroup"])
+    expect_exact("jobs will not be limited", "shell did not warn")
+    expect_prompt()
+    sendline("echo still runs")
+    expect_exact("still runs", "job did not run without a cgroup")
+    expect_prompt()
+    sendline("exit")
+    expect_exact("exit\r\n", "Shell output extraneous characters")
+    test_success()
+
+console = setup_tests([" -c " + parent])
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+sendline("sleep 30 &")
+(jobid, pid) = parse_bg_status()
+expect_prompt()
+cgroup = [l.strip().split(":", 2)[2] for l in open("/proc/%s/cgroup" % pid)
+          if l.startswith("0::")][0]
+assert cgroup.endswith("/cush-test-%d/job%s" % (os.getpid(), jobid)), \
+    "job is not in its cgroup: " + cgroup
+
+sendline("jobs -l")
+expect(r"pressure\s+cpu some \d+\.\d\d% full \d+\.\d\d%\s+memory some",
+       "pressure not listed")
+expect_prompt()
+
+# the memory controller may not be available for delegation
+sendline("limit %" + jobid + " mem=64M")
+index = console.expect(["Operation not supported",
+                        testutils.settings_module.prompt])
+if index == 0:
+    expect_prompt()
+else:
+    limit = open(parent + "/job" + jobid + "/memory.max").read().strip()
+    assert limit == str(64 * 1024 * 1024), "memory limit not set: " + limit
+
+sendline("limit %" + jobid + " mem=lots")
+expect_exact("Invalid argument", "limit accepted an invalid size")
+expect_prompt()
+
+run_builtin("kill", jobid)
+expect_exact("Terminated", "killed job was not reported")
+expect_prompt()
+# let readline redraw its line after the notice before typing again
+time.sleep(0.5)
+assert not os.path.exists(parent + "/job" + jobid), \
+    "job's cgroup was not removed"
+
+sendline("exit")
+expect_exact("exit\r\n", "Shell output extraneous characters")
+
+test_success()
@@ -14,6 +14,14 @@
 #include <sys/wait.h>
 #include <assert.h>
 #include <fcntl.h>
+#include <errno.h>
+#include <sys/syscall.h>
+#include <sys/signalfd.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/prctl.h>
+#include <getopt.h>
+#include <paths.h>
 #include "spawn.h"
 #include <readline/readline.h>
 #include <readline/history.h>
@@ -25,15 +33,35 @@
 #include "signal_support.h"
 #include "shell-ast.h"
 #include "utils.h"
-
-static void handle_child_status(pid_t pid, int status);
+#include "pid_table.h"
+#include "jid_alloc.h"
+#include "event_loop.h"
+#include "reap_ring.h"
+#include "proc_usage.h"
+#include "path_cache.h"
+#include "spawn_template.h"
+#include "zygote.h"
+#include "placement.h"
+#include "bg_sched.h"
+#include "job_cgroup.h"
+#include "parallel.h"
+#include "admission.h"
+#include "deadline.h"
+#include "watchdog.h"
+
+static void handle_child_status(const struct reap_record *rec);
+static void start_ready_jobs(void);
+static int queued_jobs_timeout(void);
 extern char **environ;
 
 static void
 usage(char *progname)
 {
-    printf("Usage: %s -h\n"
-        " -h            print this help\n",
+    printf("Usage: %s [-h] [-z] [-c cgroup] [-r]\n"
+        " -h            print this help\n"
+        " -z            spawn commands through a helper process\n"
+        " -c cgroup     run each job in a cgroup under this cgroup v2 directory\n"
+        " -r            adopt the processes jobs leave behind (child subreaper)\n",
         progname);
 
     exit(EXIT_SUCCESS);
@@ -53,6 +81,38 @@ enum job_status {
     STOPPED,        /* job is stopped via SIGSTOP */
     NEEDSTERMINAL,  /* job is stopped because it was a background job
                        and requires exclusive terminal access */
+    QUEUED,         /* background job waiting for admission (bglimit);
+                       none of its processes have been spawned */
+    PENDING,        /* background job waiting for other jobs to finish
+                       (after); none of its processes have been spawned */
+};
+
+struct job;
+
+/* An edge of the job dependency graph: 'waiter' is PENDING until
+ * 'job' is done */
+struct job_dep {
+    struct list_elem elem;   /* Link element for job->dependents */
+    struct job *job;         /* NULL once it is done */
+    struct job *waiter;
+};
+
+/* One process spawned for a job, i.e., one stage of its pipeline.
+ * Every live process is entered in the pid table so that a reaped
+ * pid can be mapped back to its job and stage in O(1).
+ */
+struct job_proc {
+    struct job *job;         /* The job this process belongs to */
+    pid_t   pid;             /* Process id, -1 if not (yet) spawned */
+    int     stage;           /* Position of the command in the pipeline,
+                                -1 for an adopted orphan */
+    bool    alive;           /* True until the process has been reaped */
+    int     status;          /* waitpid() status once it terminated */
+    struct rusage usage;     /* Resources it used, from wait4() */
+    struct event_source exit_ev;  /* pidfd, readable once the process
+                                     has terminated; fd is -1 if none */
+    int     stat_fd;         /* Its /proc/<pid>/stat for the watchdog,
+                                -1 if not open */
 };
 
 struct job {
@@ -66,31 +126,247 @@ struct job {
 
     /* Add additional fields here if needed. */
 
-    int pid;
+    struct job_proc *procs;  /* One entry per command of the pipeline */
+    int cgroup_fd;           /* Its cgroup (job_cgroup.h), -1 if none */
+    bool managed;            /* Run by the parallel builtin, which reaps it
+                                without announcing or reporting it */
+    int output_fd;           /* Where its last stage writes instead of
+                                stdout, -1 for stdout */
+    bool waited;             /* The wait builtin is waiting for it */
+    struct list dependents;  /* Edges from the PENDING jobs waiting for it */
+    struct job_dep *deps;    /* If PENDING, the edges to the jobs it waits for */
+    int ndeps;
+    int deps_left;           /* ... that are not done yet */
+    bool deps_failed;        /* One of them did not exit with status 0 */
+    bool run_always;         /* Run even if one of them failed */
+    struct list_elem ready_elem; /* Link element for ready_jobs */
+    uint64_t time_limit;     /* How long it may run in ns, 0 if forever */
+    uint64_t kill_grace;     /* ns from SIGTERM to SIGKILL once it is up */
+    bool time_up;            /* SIGTERM was sent */
+    struct deadline deadline;   /* When it gets the next signal */
+    struct watchdog_sample sampled;  /* Usage of its live processes */
+    unsigned sample_pass;    /* Watchdog pass 'sampled' is from */
+    struct list_elem sample_elem;   /* Link element for that pass */
+    char watchdog_note[64];  /* What the watchdog acted on, "" if nothing */
+    struct list_elem done_elem;  /* Link element for done_list */
+    struct list_elem queue_elem; /* Link element for queued_jobs */
+    bool counted_running;    /* Counted in running_jobs */
+    bool stays_niced;        /* Kept its background nice value in the
+                                foreground (bg_sched_raise()) */
     int numChildren; 
     int pgid;
+
+    /* CLOCK_MONOTONIC timestamps for 'time' */
+    struct timespec parsed_at;   /* its command line was parsed */
+    struct timespec spawned_at;  /* first posix_spawnp() returned */
+    struct timespec exited_at;   /* its last process was reaped */
 };
 
 /* Utility functions for job list management.
- * We use 2 data structures: 
- * (a) an array jid2job to quickly find a job based on its id
+ * We use these data structures: 
+ * (a) an array jid2job to quickly find a job based on its id.
+ *     Job ids come from jid_alloc.h, which hands out the smallest
+ *     free id, so the array is grown on demand and stays dense.
+ *     It is halved again once the jids in use fit in a quarter.
  * (b) a linked list to support iteration
+ * (c) a pid table (pid_table.h) to find the job and pipeline
+ *     stage that a reaped child belongs to
+ * (d) another, keyed by process group, for the job an orphan
+ *     belongs to
+ * Jobs whose last process has been reaped are also queued on
+ * done_list, so they can all be reported and deleted in one pass.
  */
-#define MAXJOBS (1<<16)
 static struct list job_list;
+static struct list done_list;
+static struct pid_table procs_by_pid;
+static struct pid_table jobs_by_pgid;
+
+/* The number of background jobs with processes still running, which
+ * the admission limits are checked against */
+static int running_jobs;
+
+/* Count 'job' in running_jobs or not, after its status or its number
+ * of live processes changed */
+static void
+job_update_running(struct job *job)
+{
+    bool running = job->status == BACKGROUND && job->num_processes_alive > 0;
+    if (running != job->counted_running) {
+        running_jobs += running ? 1 : -1;
+        job->counted_running = running;
+    }
+}
+
+/* Return the waitpid() status of the last stage of 'job' that was
+ * spawned, which stands for the job's.  Stages that could not be
+ * spawned have no status; if none was, 127 as for a command that was
+ * not found. */
+static int
+job_last_status(struct job *job)
+{
+    for (int i = list_size(&job->pipe->commands) - 1; i >= 0; i--)
+        if (job->procs[i].pid != -1)
+            return job->procs[i].status;
+    return W_EXITCODE(127, 0);
+}
+
+/* Return true if 'job' did not exit with status 0 (see job_last_status()) */
+static bool
+job_failed(struct job *job)
+{
+    int status = job_last_status(job);
+    return !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+}
+
+/* Progress of the wait builtin, counted as waited jobs finish */
+static int wait_outstanding;    /* jobs still running */
+static int wait_finished;       /* jobs that finished or stopped */
+static int wait_failed;         /* ... of which did not exit with 0 */
+
+/* Count off 'job' for the wait builtin */
+static void
+wait_job_done(struct job *job, bool failed)
+{
+    job->waited = false;
+    wait_outstanding--;
+    wait_finished++;
+    if (failed)
+        wait_failed++;
+}
+static struct list queued_jobs;     /* QUEUED jobs, oldest first */
+static struct list ready_jobs;      /* PENDING jobs whose dependencies
+                                       are all done */
+
+/* Tell the PENDING jobs that wait for 'job' that it is done.  Those
+ * that were waiting only for it are queued on ready_jobs, for
+ * start_ready_jobs(). */
+static void
+job_deps_resolve(struct job *job, bool failed)
+{
+    while (!list_empty(&job->dependents)) {
+        struct job_dep *dep = list_entry(list_pop_front(&job->dependents),
+                                         struct job_dep, elem);
+        struct job *waiter = dep->waiter;
+        dep->job = NULL;
+        if (failed)
+            waiter->deps_failed = true;
+        if (--waiter->deps_left == 0)
+            list_push_back(&ready_jobs, &waiter->ready_elem);
+    }
+}
 
-static struct job * jid2job[MAXJOBS];
+static struct job ** jid2job;
+static int jid2job_size;
 
 /* Return job corresponding to jid */
 static struct job * 
 get_job_from_jid(int jid)
 {
-    if (jid > 0 && jid < MAXJOBS && jid2job[jid] != NULL)
+    if (jid > 0 && jid < jid2job_size && jid2job[jid] != NULL)
         return jid2job[jid];
 
     return NULL;
 }
 
+/* Return the job whose process group is 'pgid', or NULL */
+static struct job *
+get_job_from_pgid(pid_t pgid)
+{
+    return pid_table_lookup(&jobs_by_pgid, pgid);
+}
+
+/* Return the job named by the argument of the builtin 'argv', as in
+ * "fg 2" or "fg %2", or say why there is none and return NULL */
+static struct job *
+get_job_from_argv(char **argv)
+{
+    const char *jidarg = argv[1];
+    if (jidarg == NULL) {
+        fprintf(stderr, "%s: usage: %s %%jid\n", argv[0], argv[0]);
+        return NULL;
+    }
+    struct job *job = get_job_from_jid(atoi(*jidarg == '%' ? jidarg + 1 : jidarg));
+    if (job == NULL)
+        fprintf(stderr, "%s: %s: no such job\n", argv[0], jidarg);
+    return job;
+}
+
+/* Return the argv with which /bin/sh runs the script 'path' whose own
+ * argv is 'argv' */
+static char **
+script_argv_for(const char *path, char **argv)
+{
+    int argc = 0;
+    while (argv[argc] != NULL)
+        argc++;
+    char **script_argv = malloc((argc + 2) * sizeof *script_argv);
+    if (script_argv == NULL)
+        utils_fatal_error("cannot allocate script arguments: ");
+    script_argv[0] = _PATH_BSHELL;
+    script_argv[1] = (char *) path;
+    memcpy(script_argv + 2, argv + 1, argc * sizeof *argv);
+    return script_argv;
+}
+
+/* Move the live processes of 'job' to the background scheduling of
+ * bgsched, or back to the shell's if 'background' is false */
+static void
+job_set_sched(struct job *job, bool background)
+{
+    int nstages = list_size(&job->pipe->commands), npids = 0;
+    pid_t *pids = malloc(nstages * sizeof *pids);
+    if (pids == NULL)
+        utils_fatal_error("cannot allocate pids: ");
+    for (int i = 0; i < nstages; i++)
+        if (job->procs[i].alive)
+            pids[npids++] = job->procs[i].pid;
+
+    if (background) {
+        bg_sched_lower(job->pgid, pids, npids);
+        job->stays_niced = false;
+    } else
+        job->stays_niced = !bg_sched_raise(job->pgid, pids, npids);
+    free(pids);
+}
+
+/* Time a job that ran out of time is given between SIGTERM and
+ * SIGKILL, in ns */
+#define JOB_KILL_GRACE (5 * 1000000000ull)
+
+/* Called when the time limit of a job is up, and again when the grace
+ * period after that is up.  A stopped job is continued so that it
+ * can act on SIGTERM. */
+static void
+job_time_up(struct deadline *d)
+{
+    struct job *job = deadline_entry(d, struct job, deadline);
+    if (job->time_up) {
+        killpg(job->pgid, SIGKILL);
+        return;
+    }
+    job->time_up = true;
+    killpg(job->pgid, SIGTERM);
+    killpg(job->pgid, SIGCONT);
+    deadline_set(d, deadline_now() + job->kill_grace);
+}
+
+/* Arm the deadline of a job with a time limit, which counts from when
+ * its first process was spawned.  Jobs that have not been spawned yet
+ * are armed by spawn_job(). */
+static void
+job_arm_deadline(struct job *job)
+{
+    if (job->num_processes_alive == 0 || job->time_up)
+        return;
+    if (job->time_limit == 0) {
+        deadline_cancel(&job->deadline);
+        return;
+    }
+    uint64_t spawned = job->spawned_at.tv_sec * 1000000000ull
+                       + job->spawned_at.tv_nsec;
+    deadline_set(&job->deadline, spawned + job->time_limit);
+}
+
 /* Add a new job to the job list */
 static struct job *
 add_job(struct ast_pipeline *pipe)
@@ -98,22 +374,58 @@ add_job(struct ast_pipeline *pipe)
     struct job * job = malloc(sizeof *job);
     job->pipe = pipe;
     job->num_processes_alive = 0;
+    job->counted_running = false;
+    job->stays_niced = false;
+    job->numChildren = 0;
+
+    int nstages = list_size(&pipe->commands);
+    job->procs = malloc(nstages * sizeof *job->procs);
+    for (int i = 0; i < nstages; i++) {
+        job->procs[i].job = job;
+        job->procs[i].pid = -1;
+        job->procs[i].stage = i;
+        job->procs[i].alive = false;
+        job->procs[i].status = 0;
+        memset(&job->procs[i].usage, 0, sizeof job->procs[i].usage);
+        job->procs[i].exit_ev.fd = -1;
+        job->procs[i].stat_fd = -1;
+    }
+    job->cgroup_fd = -1;
+    job->managed = false;
+    job->output_fd = -1;
+    job->waited = false;
+    list_init(&job->dependents);
+    job->deps = NULL;
+    job->ndeps = job->deps_left = 0;
+    job->deps_failed = job->run_always = false;
+    job->time_limit = 0;
+    job->kill_grace = JOB_KILL_GRACE;
+    job->time_up = false;
+    deadline_init(&job->deadline, job_time_up);
+    job->sample_pass = 0;
+    job->watchdog_note[0] = '\0';
     list_push_back(&job_list, &job->elem);
-    for (int i = 1; i < MAXJOBS; i++) {
-        if (jid2job[i] == NULL) {
-            jid2job[i] = job;
-            job->jid = i;
-            return job;
-        }
+
+    job->jid = jid_alloc();
+    if (job->jid >= jid2job_size) {
+        int newsize = jid2job_size ? 2 * jid2job_size : 64;
+        while (newsize <= job->jid)
+            newsize *= 2;
+        jid2job = realloc(jid2job, newsize * sizeof *jid2job);
+        if (jid2job == NULL)
+            utils_fatal_error("cannot grow job table: ");
+        memset(jid2job + jid2job_size, 0,
+               (newsize - jid2job_size) * sizeof *jid2job);
+        jid2job_size = newsize;
     }
-    fprintf(stderr, "Maximum number of jobs exceeded\n");
-    abort();
-    return NULL;
+    jid2job[job->jid] = job;
+    return job;
 }
 
 /* Delete a job.
  * This should be called only when all processes that were
  * forked for this job are known to have terminated.
+ * A job whose pipe is NULL had only borrowed its pipeline.
  */
 static void
 delete_job(struct job *job)
@@ -122,7 +434,36 @@ delete_job(struct job *job)
     assert(jid != -1);
     jid2job[jid]->jid = -1;
     jid2job[jid] = NULL;
-    ast_pipeline_free(job->pipe);
+    jid_free(jid);
+    //Halve the table once the jids in use fit in a quarter of it
+    while (jid2job_size > 64 && jid_limit() <= jid2job_size / 4) {
+        jid2job_size /= 2;
+        jid2job = realloc(jid2job, jid2job_size * sizeof *jid2job);
+        if (jid2job == NULL)
+            utils_fatal_error("cannot shrink job table: ");
+    }
+    if (job->counted_running)
+        running_jobs--;
+    if (job->numChildren > 0 && get_job_from_pgid(job->pgid) == job)
+        pid_table_remove(&jobs_by_pgid, job->pgid);
+    job_cgroup_destroy(job->cgroup_fd);
+    deadline_cancel(&job->deadline);
+    if (job->waited)
+        wait_job_done(job, true);
+
+    //A job deleted before it ran never succeeded
+    if (job->deps != NULL) {
+        for (int i = 0; i < job->ndeps; i++)
+            if (job->deps[i].job != NULL)
+                list_remove(&job->deps[i].elem);
+        if (job->deps_left == 0)
+            list_remove(&job->ready_elem);
+        free(job->deps);
+    }
+    job_deps_resolve(job, true);
+    if (job->pipe)
+        ast_pipeline_free(job->pipe);
+    free(job->procs);
     free(job);
 }
 
@@ -138,6 +479,10 @@ get_status(enum job_status status)
         return "Stopped";
     case NEEDSTERMINAL:
         return "Stopped (tty)";
+    case QUEUED:
+        return "Queued";
+    case PENDING:
+        return "Pending";
     default:
         return "Done";
     }
@@ -165,38 +510,505 @@ print_job(struct job *job)
 {
     printf("[%d]\t%s\t\t(", job->jid, get_status(job->status));
     print_cmdline(job->pipe);
-    printf(")\n");
+    printf(")");
+    if (job->status == PENDING && job->deps_left > 0) {
+        printf(" after");
+        for (int i = 0; i < job->ndeps; i++)
+            if (job->deps[i].job != NULL)
+                printf(" %%%d", job->deps[i].job->jid);
+    }
+    if (job->watchdog_note[0] != '\0')
+        printf(" [watchdog: %s]", job->watchdog_note);
+    printf("\n");
+}
+
+/* Print a job followed by one line per process with the resources
+ * it used, and the job's total.  Usage of processes that have not
+ * been reaped yet is sampled from /proc. */
+static void
+print_job_long(struct job *job)
+{
+    struct rusage total;
+    memset(&total, 0, sizeof total);
+
+    print_job(job);
+    int nstages = list_size(&job->pipe->commands);
+    int orphans = job->num_processes_alive;
+    struct list_elem * e = list_begin(&job->pipe->commands);
+    for (int i = 0; i < nstages; i++, e = list_next(e)) {
+        struct job_proc *proc = &job->procs[i];
+        if (proc->pid == -1)
+            continue;
+        if (proc->alive)
+            orphans--;
+
+        struct rusage usage;
+        const char *state;
+        if (proc->alive) {
+            state = proc_usage_read(proc->pid, &usage) ? "running" : "gone";
+        } else {
+            usage = proc->usage;
+            state = WIFSIGNALED(proc->status) ? "killed" : "exited";
+        }
+        proc_usage_add(&total, &usage);
+
+        struct ast_command *cmd = list_entry(e, struct ast_command, elem);
+        printf("\t%d\t%-8s", proc->pid, state);
+        proc_usage_print(&usage);
+        printf("\t%s\n", cmd->argv[0]);
+    }
+    if (orphans > 0)
+        printf("\t\tadopted %d process%s left behind\n", orphans,
+               orphans == 1 ? "" : "es");
+    if (job->stays_niced)
+        printf("\t\tniced as a background job, not raised by fg\n");
+    printf("\ttotal\t\t");
+    proc_usage_print(&total);
+    printf("\n");
+    if (job->cgroup_fd != -1)
+        job_cgroup_print_pressure(job->cgroup_fd);
 }
 
 
 /*
- * Suggested SIGCHLD handler.
+ * Child monitoring.
  *
- * Call waitpid() to learn about any child processes that
- * have exited or changed status (been stopped, needed the
- * terminal, etc.)
- * Just record the information by updating the job list
- * data structures.  Since the call may be spurious (e.g.
- * an already pending SIGCHLD is delivered even though
- * a foreground process was already reaped), ignore when
- * waitpid returns -1.
- * Use a loop with WNOHANG since only a single SIGCHLD 
- * signal may be delivered for multiple children that have 
- * exited. All of them need to be reaped.
+ * Every spawned process is watched through a pidfd, which becomes
+ * readable once the process has terminated.  The pidfd is returned
+ * by posix_spawn itself (posix_spawnattr_setpidfd_np), so unlike one
+ * obtained with pidfd_open() afterwards, it cannot refer to another
+ * process that reused the pid of one that exited right away, and no
+ * extra system call is needed.  Its handler then reaps
+ * exactly that pid, so there is no waitpid(-1) and no signal handler
+ * that could run in the middle of the job list being updated.
+ *
+ * pidfds do not report stops, so SIGCHLD is kept blocked and received
+ * through a signalfd instead.  Its handler collects stop notifications
+ * with waitid(WSTOPPED), which leaves terminated children to their
+ * pidfd.  If the kernel does not support pidfds, it reaps terminated
+ * children as well.
+ *
+ * These handlers do no job bookkeeping themselves: they only push
+ * (pid, status, timestamp) records into the reap ring.  The shell
+ * drains the ring in batches before each prompt and while waiting
+ * for a foreground job.  If the ring is full, a handler leaves the
+ * status uncollected and flags an overflow, and the drain falls back
+ * to a full waitpid() sweep.  pidfds are registered EPOLLONESHOT so
+ * an uncollected exit does not keep the loop spinning.
  */
+static struct event_source sigchld_ev;
+static bool pidfd_unavailable;
+static bool subreaper;          /* Orphans are reparented to the shell */
+static bool children_changed;   /* SIGCHLD arrived since the last scan */
+
+/* Convert what waitid() reports into a waitpid()-style status */
+static int
+siginfo_to_status(siginfo_t *info)
+{
+    switch (info->si_code) {
+    case CLD_EXITED:
+        return W_EXITCODE(info->si_status, 0);
+    case CLD_KILLED:
+        return W_EXITCODE(0, info->si_status);
+    case CLD_DUMPED:
+        return W_EXITCODE(0, info->si_status) | WCOREFLAG;
+    default:
+        return W_STOPCODE(info->si_status);
+    }
+}
+
+/* The pidfd of a job's process became readable */
 static void
-sigchld_handler(int sig, siginfo_t *info, void *_ctxt)
+job_proc_exit_ready(struct event_source *src, uint32_t events)
 {
-    pid_t child;
+    struct job_proc *proc = event_source_entry(src, struct job_proc, exit_ev);
     int status;
 
-    assert(sig == SIGCHLD);
+    if (reap_ring_full()) {
+        reap_ring_set_overflow();
+        return;
+    }
+    struct rusage usage;
+    if (proc->alive && wait4(proc->pid, &status, WNOHANG, &usage) > 0)
+        reap_ring_push(proc->pid, status, &usage);
+}
+
+/* Start watching a freshly spawned process through the (close-on-exec)
+ * pidfd that was returned when it was spawned, -1 if there is none */
+static void
+job_proc_watch(struct job_proc *proc, int pidfd)
+{
+    if (pidfd == -1) {
+        /* Fall back to reaping from the SIGCHLD handler */
+        pidfd_unavailable = true;
+        return;
+    }
+    proc->exit_ev.fd = pidfd;
+    proc->exit_ev.handler = job_proc_exit_ready;
+    event_loop_add(&proc->exit_ev, EPOLLIN | EPOLLONESHOT);
+}
+
+/*
+ * Orphans.
+ *
+ * With -r, the shell is a child subreaper: when a process dies, its
+ * children are reparented to the shell instead of init.  Every child
+ * of the shell that is not in the pid table has been adopted this way
+ * (or is the spawner of -z).  It is watched through a pidfd like any
+ * spawned process, and if it is still in the process group of a job
+ * that has processes left, it is counted among them.  All jobs share
+ * the shell's session, so the process group is what tells them apart;
+ * orphans that left it, e.g. daemons that called setsid(), are reaped
+ * without being attributed to any job.
+ *
+ * Orphans are adopted silently, so the shell looks for them whenever
+ * it received SIGCHLD, and before the last process it knows of in a
+ * job is counted off, which keeps a job from being reported as done
+ * while processes it left behind in its group are still running.
+ */
+static void
+adopt_orphan(pid_t pid)
+{
+    int pidfd = syscall(SYS_pidfd_open, pid, 0);
+    if (pidfd == -1)
+        return;
+
+    struct job *job = get_job_from_pgid(getpgid(pid));
+    if (job != NULL && job->num_processes_alive == 0)
+        job = NULL;
+
+    struct job_proc *proc = malloc(sizeof *proc);
+    if (proc == NULL)
+        utils_fatal_error("cannot allocate orphan: ");
+    proc->job = job;
+    proc->pid = pid;
+    proc->stage = -1;
+    proc->alive = true;
+    proc->status = 0;
+    memset(&proc->usage, 0, sizeof proc->usage);
+    proc->exit_ev.fd = -1;
+    proc->stat_fd = -1;
+    pid_table_insert(&procs_by_pid, pid, proc);
+    job_proc_watch(proc, pidfd);
+    if (job != NULL) {
+        job->num_processes_alive++;
+        job_update_running(job);
+    }
+}
+
+/* Adopt the children of the shell that are not in the pid table,
+ * other than the spawn helper */
+static void
+adopt_orphans(void)
+{
+    char path[64];
+    snprintf(path, sizeof path, "/proc/self/task/%d/children", getpid());
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+        return;
+
+    int pid;
+    while (fscanf(f, "%d", &pid) == 1)
+        if (pid != zygote_pid() && pid_table_lookup(&procs_by_pid, pid) == NULL)
+            adopt_orphan(pid);
+    fclose(f);
+    children_changed = false;
+}
+
+/* SIGCHLD is pending: some child stopped (or, without pidfds, exited) */
+static void
+sigchld_ready(struct event_source *src, uint32_t events)
+{
+    struct signalfd_siginfo fdsi[16];
+    while (read(src->fd, fdsi, sizeof fdsi) > 0)
+        continue;
+    children_changed = true;
 
-    while ((child = waitpid(-1, &status, WUNTRACED|WNOHANG)) > 0) {
-        handle_child_status(child, status);
+    int options = WSTOPPED | WNOHANG | (pidfd_unavailable ? WEXITED : 0);
+    for (;;) {
+        if (reap_ring_full()) {
+            reap_ring_set_overflow();
+            break;
+        }
+
+        /* The raw system call, unlike glibc's waitid(), also
+         * reports the resource usage of a reaped child. */
+        siginfo_t info = { .si_pid = 0 };
+        struct rusage usage;
+        if (syscall(SYS_waitid, P_ALL, 0, &info, options, &usage) == -1
+            || info.si_pid == 0)
+            break;
+
+        reap_ring_push(info.si_pid, siginfo_to_status(&info),
+                       info.si_code == CLD_STOPPED ? NULL : &usage);
     }
 }
 
+/* Apply all child status changes collected so far to the jobs */
+static void
+drain_child_events(void)
+{
+    struct reap_record batch[64];
+    size_t n;
+
+    if (subreaper && children_changed)
+        adopt_orphans();
+
+    while ((n = reap_ring_pop(batch, sizeof batch / sizeof batch[0])) > 0)
+        for (size_t i = 0; i < n; i++)
+            handle_child_status(&batch[i]);
+
+    if (reap_ring_test_and_clear_overflow()) {
+        struct reap_record rec;
+
+        while ((rec.pid = wait4(-1, &rec.status, WUNTRACED|WNOHANG,
+                                &rec.usage)) > 0) {
+            clock_gettime(CLOCK_MONOTONIC, &rec.when);
+            handle_child_status(&rec);
+        }
+    }
+}
+
+/* Set up the event sources through which children are monitored */
+static void
+child_monitor_init(void)
+{
+    event_loop_init();
+    sigchld_ev.fd = signal_create_fd(SIGCHLD);
+    sigchld_ev.handler = sigchld_ready;
+    event_loop_add(&sigchld_ev, EPOLLIN);
+}
+
+/*
+ * Terminal input.
+ *
+ * The prompt is driven by readline's callback interface: the shell
+ * waits in the event loop on the terminal together with the pidfds
+ * and the SIGCHLD signalfd, and hands characters to readline as they
+ * arrive.  Child status changes are applied while the shell is idle
+ * at the prompt, so completion notices are printed, and finished
+ * jobs freed, as soon as children exit rather than when the user
+ * next presses Enter.  The terminal is only monitored while the
+ * prompt is shown, so input typed ahead during a foreground job
+ * does not wake the shell.
+ */
+static struct event_source stdin_ev;
+static bool stdin_monitored;    /* false if stdin cannot be polled */
+static bool at_prompt;          /* readline's input line is on screen */
+static bool prompt_clobbered;   /* and has been cleared for a notice */
+static bool line_complete;
+static char *completed_line;
+
+/* Called before printing an asynchronous notification.  If the
+ * prompt is displayed, erase it so the notice does not end up in
+ * the middle of the user's input; it is redrawn afterwards. */
+static void
+async_notify_begin(void)
+{
+    if (at_prompt && !prompt_clobbered) {
+        rl_clear_visible_line();
+        prompt_clobbered = true;
+    }
+}
+
+/* Redraw the prompt and the partial input after notifications */
+static void
+async_notify_end(void)
+{
+    fflush(stdout);
+    if (prompt_clobbered) {
+        rl_on_new_line();
+        rl_redisplay();
+        prompt_clobbered = false;
+    }
+}
+
+/* The watchdog samples all live processes once per interval */
+static struct deadline watchdog_deadline;
+static unsigned watchdog_pass;
+
+/* Add the usage of process 'pid' to the sample of its job, and put
+ * the job on the list 'arg' the first time one of its processes is
+ * sampled in this pass */
+static void
+watchdog_sample_proc(pid_t pid, void *value, void *arg)
+{
+    struct job_proc *proc = value;
+    struct job *job = proc->job;
+    struct watchdog_sample usage;
+
+    if (job == NULL || !watchdog_sample(pid, &proc->stat_fd, &usage))
+        return;
+    if (job->sample_pass != watchdog_pass) {
+        job->sample_pass = watchdog_pass;
+        job->sampled.rss = job->sampled.cpu = 0;
+        list_push_back(arg, &job->sample_elem);
+    }
+    job->sampled.rss += usage.rss;
+    job->sampled.cpu += usage.cpu;
+}
+
+/* Sample the processes in the pid table and act on the jobs that are
+ * over a threshold.  Each job is acted on only once; it is marked in
+ * the jobs listing from then on. */
+static void
+watchdog_tick(struct deadline *d)
+{
+    struct list sampled;
+    list_init(&sampled);
+    watchdog_pass++;
+    pid_table_foreach(&procs_by_pid, watchdog_sample_proc, &sampled);
+
+    for (struct list_elem *e = list_begin(&sampled);
+         e != list_end(&sampled); e = list_next(e)) {
+        struct job *job = list_entry(e, struct job, sample_elem);
+        if (job->watchdog_note[0] != '\0'
+            || !watchdog_exceeded(&job->sampled, job->watchdog_note,
+                                  sizeof job->watchdog_note))
+            continue;
+
+        int sig = watchdog_signal();
+        async_notify_begin();
+        printf("[%d]\twatchdog: %s, sending SIG%s\n", job->jid,
+               job->watchdog_note, sigabbrev_np(sig));
+        killpg(job->pgid, sig);
+    }
+    deadline_set(d, deadline_now() + watchdog_interval());
+}
+
+/* Start or stop sampling after the watchdog settings changed */
+static void
+watchdog_update(void)
+{
+    if (watchdog_enabled())
+        deadline_set(&watchdog_deadline, deadline_now() + watchdog_interval());
+    else
+        deadline_cancel(&watchdog_deadline);
+}
+
+/* Return the time from 'from' to 'to' in milliseconds */
+static double
+elapsed_ms(const struct timespec *from, const struct timespec *to)
+{
+    return (to->tv_sec - from->tv_sec) * 1e3
+         + (to->tv_nsec - from->tv_nsec) / 1e6;
+}
+
+/* Report the times of a job run with 'time' to stderr: the wall
+ * clock time from parsing its command line until its last process
+ * exited, the CPU time used by all its processes, and how much of
+ * the wall clock time the shell itself spent before the first
+ * process was spawned and after the last one exited. */
+static void
+print_job_times(struct job *job)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    struct rusage total;
+    memset(&total, 0, sizeof total);
+    for (int i = 0; i < list_size(&job->pipe->commands); i++)
+        if (job->procs[i].pid != -1)
+            proc_usage_add(&total, &job->procs[i].usage);
+
+    fprintf(stderr, "real\t%.3fs\n",
+            elapsed_ms(&job->parsed_at, &job->exited_at) / 1e3);
+    fprintf(stderr, "user\t%ld.%03lds\n", (long) total.ru_utime.tv_sec,
+            (long) total.ru_utime.tv_usec / 1000);
+    fprintf(stderr, "sys\t%ld.%03lds\n", (long) total.ru_stime.tv_sec,
+            (long) total.ru_stime.tv_usec / 1000);
+    fprintf(stderr, "shell\t%.3fms to spawn, %.3fms to prompt\n",
+            elapsed_ms(&job->parsed_at, &job->spawned_at),
+            elapsed_ms(&job->exited_at, &now));
+}
+
+/* Report all jobs whose processes have terminated, bash-style, and
+ * delete them along with their pipelines.  Jobs that ran in the
+ * foreground, or were killed by a signal (which was reported when it
+ * happened), are deleted silently. */
+static void
+reclaim_finished_jobs(void)
+{
+    while (!list_empty(&done_list)) {
+        struct list_elem *e = list_pop_front(&done_list);
+        struct job *job = list_entry(e, struct job, done_elem);
+        int status = job_last_status(job);
+
+        if (job->status != FOREGROUND && WIFEXITED(status)) {
+            async_notify_begin();
+            if (WEXITSTATUS(status) == 0)
+                printf("[%d]\tDone\t\t(", job->jid);
+            else
+                printf("[%d]\tExit %d\t\t(", job->jid, WEXITSTATUS(status));
+            print_cmdline(job->pipe);
+            printf(")\n");
+        }
+        if (job->pipe->timed) {
+            async_notify_begin();
+            print_job_times(job);
+        }
+        list_remove(&job->elem);
+        delete_job(job);
+    }
+}
+
+static void
+stdin_readable(struct event_source *src, uint32_t events)
+{
+    rl_callback_read_char();
+}
+
+/* readline has assembled a line, or NULL at EOF */
+static void
+line_handler(char *line)
+{
+    rl_callback_handler_remove();
+    completed_line = line;
+    line_complete = true;
+}
+
+/* Display 'prompt' and read a command line.  Returns NULL at EOF. */
+static char *
+read_command_line(const char *prompt)
+{
+    if (!stdin_monitored)
+        return readline(prompt);
+
+    line_complete = false;
+    at_prompt = true;
+    rl_callback_handler_install(prompt, line_handler);
+    event_loop_add(&stdin_ev, EPOLLIN);
+
+    while (!line_complete) {
+        /* let readline act on signals it caught, e.g., SIGWINCH */
+        if (event_loop_wait(queued_jobs_timeout()) == -1)
+            rl_check_signals();
+
+        drain_child_events();
+        reclaim_finished_jobs();
+        start_ready_jobs();
+        async_notify_end();
+    }
+
+    event_loop_remove(&stdin_ev);
+    at_prompt = false;
+    return completed_line;
+}
+
+/* Read terminal input through the event loop, unless stdin is a
+ * regular file, which epoll cannot monitor (and which never blocks) */
+static void
+stdin_monitor_init(void)
+{
+    struct stat st;
+    if (fstat(STDIN_FILENO, &st) == -1 || S_ISREG(st.st_mode))
+        return;
+
+    stdin_ev.fd = STDIN_FILENO;
+    stdin_ev.handler = stdin_readable;
+    stdin_monitored = true;
+}
+
 /* Wait for all processes in this job to complete, or for
  * the job no longer to be in the foreground.
  * You should call this function from a) where you wait for
@@ -225,38 +1037,68 @@ wait_for_job(struct job *job)
 {
     assert(signal_is_blocked(SIGCHLD));
 
-
-    while (job->status == FOREGROUND && job->num_processes_alive > 0) {
-        int status;
-
-
-        //waits for next child porcess to die, when you pass -1 it just waits for the next process
-        //waitpid returns status
-        pid_t child = waitpid(-1, &status, WUNTRACED);
-
-        // When called here, any error returned by waitpid indicates a logic
-        // bug in the shell.
-        // In particular, ECHILD "No child process" means that there has
-        // already been a successful waitpid() call that reaped the child, so
-        // there's likely a bug in handle_child_status where it failed to update
-        // the "job" status and/or num_processes_alive fields in the required
-        // fashion.
-        // Since SIGCHLD is blocked, there cannot be races where a child's exit
-        // was handled via the SIGCHLD signal handler.
-        if (child != -1)
-            handle_child_status(child, status);
-        else{
-            utils_fatal_error("waitpid is failed");
-        }
+    //Each pass applies the status changes collected by the event
+    //handlers, then waits for more pidfds or SIGCHLD to become ready
+    for (;;) {
+        drain_child_events();
+        start_ready_jobs();
+        if (job->status != FOREGROUND || job->num_processes_alive == 0)
+            break;
+        event_loop_wait(queued_jobs_timeout());
     }
 }
 
+/* Record the termination status and resource usage of 'proc' from
+ * 'rec' and drop it from the pid table.  Once no process of its job
+ * is left, the job is queued for reclaim_finished_jobs(). */
+static void
+job_proc_reaped(struct job_proc *proc, const struct reap_record *rec)
+{
+    assert(proc->alive);
+    proc->alive = false;
+    pid_table_remove(&procs_by_pid, proc->pid);
+    if (proc->exit_ev.fd != -1) {
+        event_loop_remove(&proc->exit_ev);
+        close(proc->exit_ev.fd);
+        proc->exit_ev.fd = -1;
+    }
+    if (proc->stat_fd != -1) {
+        close(proc->stat_fd);
+        proc->stat_fd = -1;
+    }
+    proc->status = rec->status;
+    proc->usage = rec->usage;
+
+    //An orphan is not part of the pipeline, and may be part of no job
+    struct job *job = proc->job;
+    if (proc->stage == -1)
+        free(proc);
+    if (job == NULL)
+        return;
+
+    //Its last process may have left others to the shell
+    if (subreaper && job->num_processes_alive == 1)
+        adopt_orphans();
+    job->num_processes_alive--;
+    job_update_running(job);
+    if (job->num_processes_alive == 0) {
+        job->exited_at = rec->when;
+        list_push_back(&done_list, &job->done_elem);
+        deadline_cancel(&job->deadline);
+        if (job->waited)
+            wait_job_done(job, job_failed(job));
+        job_deps_resolve(job, job_failed(job));
+    }
+}
 
 static void
-handle_child_status(pid_t pid, int status)
+handle_child_status(const struct reap_record *rec)
 {
      assert(signal_is_blocked(SIGCHLD));
 
+    pid_t pid = rec->pid;
+    int status = rec->status;
+
     /* To be implemented. 
      * Step 1. Given the pid, determine which job this pid is a part of
      *         (how to do this is not part of the provided code.)
@@ -267,21 +1109,25 @@ handle_child_status(pid_t pid, int status)
      *         If a process was stopped, save the terminal state.
      */
 
-    struct job * currentJob = NULL;
-    struct list_elem * e = list_begin(&job_list);
-    
-    for(; e != list_end(&job_list); e = list_next(e)){
-        currentJob = list_entry(e, struct job, elem);
+    struct job_proc * proc = pid_table_lookup(&procs_by_pid, pid);
 
-        if(currentJob->pid == pid){
-            break;
-        }
+    /* Not a process we spawned for any job */
+    if (proc == NULL)
+        return;
+
+    struct job * currentJob = proc->job;
+
+    //Orphans are only counted off, without reports or job state changes
+    if (proc->stage == -1) {
+        if (WIFEXITED(status) || WIFSIGNALED(status))
+            job_proc_reaped(proc, rec);
+        return;
     }
 
     if (WIFEXITED(status))
     {   
         int statusCode = WEXITSTATUS(status);
-        currentJob->num_processes_alive--;
+        job_proc_reaped(proc, rec);
 
         if(statusCode == 0 && currentJob->status==FOREGROUND){
             termstate_sample();
@@ -290,33 +1136,34 @@ handle_child_status(pid_t pid, int status)
 
     if (WIFSIGNALED(status))
     {
+        async_notify_begin();
         //Cases:
         //Ctrl-C 
         if (WTERMSIG(status) == SIGINT)
         {
             currentJob->status = FOREGROUND;
-            currentJob->num_processes_alive--;
+            job_proc_reaped(proc, rec);
             printf("%s\n", strsignal(WTERMSIG(status)));
         }
 
         //User terminate process with kill
         else if (WTERMSIG(status) == SIGTERM)
         {
-            currentJob->num_processes_alive--;
+            job_proc_reaped(proc, rec);
             printf("%s\n", strsignal(WTERMSIG(status)));
         }
 
         //User terminate process with kill -9
         else if (WTERMSIG(status) == SIGKILL)
         {
-            currentJob->num_processes_alive--;
+            job_proc_reaped(proc, rec);
             printf("%s\n", strsignal(WTERMSIG(status)));
         }
 
         //Process has been terminated, general case
         else
         {   
-            currentJob->num_processes_alive--;
+            job_proc_reaped(proc, rec);
             printf("%s\n", strsignal(WTERMSIG(status)));
         }
     }
@@ -324,10 +1171,14 @@ handle_child_status(pid_t pid, int status)
     if (WIFSTOPPED(status))
     {
         termstate_save(&currentJob->saved_tty_state);
+        //A stopped job would never finish, so stop waiting for it
+        if (currentJob->waited)
+            wait_job_done(currentJob, false);
         //Cases:
         //Ctrl-Z
         if (WSTOPSIG(status) == SIGTSTP)
         {
+            async_notify_begin();
             currentJob->status = STOPPED;
             print_job(currentJob);
         }
@@ -343,6 +1194,807 @@ handle_child_status(pid_t pid, int status)
         {
             currentJob->status = NEEDSTERMINAL;
         }
+        job_update_running(currentJob);
+    }
+}
+
+/* Spawn one process for each command of the job's pipeline, connected
+ * by pipes, in a new process group.  Processes that are spawned are
+ * entered in the pid table and watched; commands that cannot be run
+ * are reported and skipped.  On return, job->numChildren tells how
+ * many processes were spawned. */
+static void
+spawn_job(struct job *currentJob)
+{
+    struct ast_pipeline *currPipe = currentJob->pipe;
+    int listSize = list_size(&currPipe->commands);
+
+    struct list_elem * e = list_begin (&currPipe->commands); 
+
+    int commandsLeft = listSize;
+    struct spawn_template *template = spawn_template_get(currPipe,
+                                                         currentJob->output_fd != -1);
+    placement_begin_job();
+    currentJob->cgroup_fd = job_cgroup_create(currentJob->jid);
+    //Initialize file descriptor for first pipe
+    int firstPipeEnds[2];
+    int i = 0;
+
+    //This is the for loop through the pipeline
+    for (; e != list_end (&currPipe->commands); e = list_next(e)) {
+        struct ast_command *currCmd = list_entry(e, struct ast_command, elem);
+        commandsLeft--;
+        i++;
+
+        struct spawn_stage *stage = &template->stages[i - 1];
+        currentJob->status = currPipe->bg_job ? BACKGROUND : FOREGROUND;
+
+        //Initialize second 2D pipe array
+        int secondPipeEnds[2]; 
+        int in_fd = -1, out_fd = -1;
+        //More than one command
+        if (listSize > 1)
+        {
+            // Piping implementation
+            if (e == list_begin(&currPipe->commands))
+            {   
+                pipe2(firstPipeEnds, O_CLOEXEC);
+                out_fd = firstPipeEnds[1];
+            }
+            else if (list_next(e) == list_end(&currPipe->commands)) 
+            {
+                in_fd = firstPipeEnds[0];
+                out_fd = currentJob->output_fd;
+            } 
+            else
+            {
+                pipe2(secondPipeEnds, O_CLOEXEC);
+                in_fd = firstPipeEnds[0];
+                out_fd = secondPipeEnds[1];
+            }            
+        }
+        else
+            out_fd = currentJob->output_fd;
+
+        //Everything else was set up when the template was built; have
+        //the spawn join the job's process group and return a pidfd
+        int pid;
+        int pidfd = -1;
+        pid_t pgid = currentJob->numChildren == 0 ? 0 : currentJob->pgid;
+        const char *path = spawn_stage_prepare(stage, pgid, in_fd, out_fd, &pidfd);
+        const cpu_set_t *cpus = placement_stage_cpus(i - 1);
+        spawn_stage_set_affinity(stage, cpus);
+        int policy = currPipe->bg_job ? bg_sched_policy() : -1;
+        spawn_stage_set_scheduler(stage, policy);
+        spawn_stage_set_cgroup(stage, currentJob->cgroup_fd);
+        //A file without a #! line is run by /bin/sh, as execvp() would;
+        //the second time around argv is that of the shell
+        char **argv = currCmd->argv;
+        char **script_argv = NULL;
+        int spawned = ENOENT;
+        for (;;) {
+            if (path != NULL && zygote_running()) {
+                struct zygote_stage request = {
+                    .path = path,
+                    .argv = argv,
+                    .pgid = pgid,
+                    .foreground = !currPipe->bg_job,
+                    .dup_stderr = currCmd->dup_stderr_to_stdout,
+                    .in_fd = in_fd,
+                    .out_fd = out_fd,
+                    .input = i == 1 ? currPipe->iored_input : NULL,
+                    .output = i == listSize ? currPipe->iored_output : NULL,
+                    .append = currPipe->append_to_output,
+                    .cpus = cpus,
+                    .policy = policy,
+                    .cgroup_fd = currentJob->cgroup_fd,
+                };
+                spawned = zygote_spawn(&request, &pid, &pidfd);
+                //A helper that cannot be reached has been shut down;
+                //the stage is spawned directly instead
+                if (spawned != 0 && !zygote_running())
+                    continue;
+            }
+            else if (path != NULL)
+                spawned = posix_spawn(&pid, path, &stage->actions, &stage->attr, argv, environ);
+            if (spawned != ENOEXEC || script_argv != NULL)
+                break;
+            script_argv = script_argv_for(path, currCmd->argv);
+            argv = script_argv;
+            path = _PATH_BSHELL;
+        }
+        free(script_argv);
+        if (i == 1)
+            clock_gettime(CLOCK_MONOTONIC, &currentJob->spawned_at);
+
+        //Need to close pipes
+        if (listSize > 1)
+        {
+            //First process, list begin
+            if(i == 1)
+            {
+                close(firstPipeEnds[1]);
+            }
+            //Middle process
+            if((i != 1) & (i != listSize)){
+                close(secondPipeEnds[1]);
+                close(firstPipeEnds[0]);
+                firstPipeEnds[0] = secondPipeEnds[0];
+            }
+            //Last process, list end
+            if(i == listSize){
+                close(firstPipeEnds[0]);
+            }
+        }
+        //Check if posix spawn return 0
+        if(spawned == 0){
+
+            if(currentJob->numChildren == 0){
+                currentJob->pgid = pid;
+                //A job whose group is gone may not have been deleted yet
+                pid_table_remove(&jobs_by_pgid, pid);
+                pid_table_insert(&jobs_by_pgid, pid, currentJob);
+            }
+
+            struct job_proc *proc = &currentJob->procs[i - 1];
+            proc->pid = pid;
+            proc->alive = true;
+            pid_table_insert(&procs_by_pid, pid, proc);
+            job_proc_watch(proc, pidfd);
+
+            currentJob->numChildren++;
+            currentJob->num_processes_alive++;
+            if (currPipe->bg_job && !currentJob->managed)
+            {
+                fprintf(stderr, "[%d] %d\n", currentJob->jid, currentJob->pgid);
+                termstate_save(&currentJob->saved_tty_state);
+            }
+            
+        }
+        //Invalid command, the other stages still run
+        else{
+            errno = spawned;
+            utils_error("%s: ", currCmd->argv[0]);
+        }
+       
+    }
+    if (currPipe->bg_job && currentJob->numChildren > 0)
+        bg_sched_renice(currentJob->pgid);
+    job_update_running(currentJob);
+    job_arm_deadline(currentJob);
+}
+
+/* Take 'job' off the admission queue and spawn it, in the background
+ * or in the foreground.  Returns false if none of its commands could
+ * be spawned, in which case it has been deleted. */
+static bool
+start_queued_job(struct job *job, bool background)
+{
+    list_remove(&job->queue_elem);
+    job->pipe->bg_job = background;
+    spawn_job(job);
+    if (job->numChildren == 0) {
+        list_remove(&job->elem);
+        delete_job(job);
+        return false;
+    }
+    return true;
+}
+
+/* Spawn queued jobs, oldest first, while the admission limits allow */
+static void
+admit_queued_jobs(void)
+{
+    while (!list_empty(&queued_jobs)
+           && admission_allows(running_jobs)) {
+        struct job *job = list_entry(list_front(&queued_jobs),
+                                     struct job, queue_elem);
+        async_notify_begin();
+        start_queued_job(job, true);
+    }
+}
+
+/* Spawn background job 'job', or queue it if the admission limits do
+ * not let it run yet */
+static void
+start_background_job(struct job *job)
+{
+    if (!list_empty(&queued_jobs) || !admission_allows(running_jobs)) {
+        job->status = QUEUED;
+        list_push_back(&queued_jobs, &job->queue_elem);
+        fprintf(stderr, "[%d] queued\n", job->jid);
+        return;
+    }
+
+    spawn_job(job);
+    //No stage could be spawned, delete from job list
+    if (job->numChildren == 0) {
+        list_remove(&job->elem);
+        delete_job(job);
+    }
+}
+
+/* Run 'job' in the background, or in the foreground and wait for it */
+static void
+run_job(struct job *job)
+{
+    //Background jobs beyond the bglimit wait their turn
+    if (job->pipe->bg_job) {
+        start_background_job(job);
+        return;
+    }
+
+    spawn_job(job);
+    //No stage could be spawned, delete from job list
+    if (job->numChildren == 0) {
+        list_remove(&job->elem);
+        delete_job(job);
+    } else
+        wait_for_job(job);
+}
+
+/* Start the pending jobs whose dependencies are all done, or cancel
+ * those for which one failed and that were not to run regardless, and
+ * then the queued jobs that the admission limits allow */
+static void
+start_ready_jobs(void)
+{
+    while (!list_empty(&ready_jobs)) {
+        struct job *job = list_entry(list_pop_front(&ready_jobs),
+                                     struct job, ready_elem);
+        free(job->deps);
+        job->deps = NULL;
+        job->ndeps = 0;
+
+        async_notify_begin();
+        if (job->deps_failed && !job->run_always) {
+            printf("[%d]\tCancelled\t(", job->jid);
+            print_cmdline(job->pipe);
+            printf(")\n");
+            list_remove(&job->elem);
+            delete_job(job);
+        } else
+            start_background_job(job);
+    }
+    admit_queued_jobs();
+}
+
+/* Return how long the event loop may wait before queued jobs need
+ * another look, -1 for as long as it takes */
+static int
+queued_jobs_timeout(void)
+{
+    return list_empty(&queued_jobs) ? -1 : admission_recheck_timeout();
+}
+
+/* Compare function for qsort() on doubles */
+static int
+compare_double(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+/* Return the p-th percentile of 'n' sorted samples (nearest rank) */
+static double
+percentile(const double *sorted, int n, int p)
+{
+    int rank = (p * n + 99) / 100;
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+/* The bench builtin: bench [-n runs] [-w warmup] pipeline
+ *
+ * 'pipe' is the pipeline as parsed, i.e., its first command starts
+ * with 'bench' and its options.  The pipeline is run in the foreground
+ * 'warmup' times and then 'runs' times, each time as a job of its own
+ * that borrows 'pipe', and the distribution of the wall clock times of
+ * the measured runs is reported along with the CPU time they used.
+ * If a run is stopped, the benchmark ends and that job keeps 'pipe'.
+ */
+static void
+bench_pipeline(struct ast_pipeline *pipe)
+{
+    struct ast_command *cmd;
+    cmd = list_entry(list_front(&pipe->commands), struct ast_command, elem);
+
+    int argc = 0;
+    while (cmd->argv[argc])
+        argc++;
+
+    int runs = 10, warmup = 0, opt;
+    optind = 0;
+    while ((opt = getopt(argc, cmd->argv, "+n:w:")) != -1) {
+        switch (opt) {
+        case 'n':
+            runs = atoi(optarg);
+            break;
+        case 'w':
+            warmup = atoi(optarg);
+            break;
+        default:
+            runs = 0;
+        }
+    }
+    if (optind == argc || runs < 1 || warmup < 0) {
+        fprintf(stderr, "usage: bench [-n runs] [-w warmup] pipeline\n");
+        return;
+    }
+
+    /* Strip 'bench' and its options off the first command */
+    for (int i = 0; i < optind; i++)
+        free(cmd->argv[i]);
+    memmove(cmd->argv, cmd->argv + optind,
+            (argc - optind + 1) * sizeof *cmd->argv);
+    pipe->bg_job = false;
+
+    double *wall = malloc(runs * sizeof *wall);
+    if (wall == NULL)
+        utils_fatal_error("cannot allocate bench samples: ");
+    struct rusage total;
+    memset(&total, 0, sizeof total);
+    int measured = 0;
+
+    for (int run = 0; run < warmup + runs; run++) {
+        struct job *job = add_job(pipe);
+        clock_gettime(CLOCK_MONOTONIC, &job->parsed_at);
+        spawn_job(job);
+        if (job->numChildren > 0)
+            wait_for_job(job);
+        termstate_give_terminal_back_to_shell();
+
+        if (job->num_processes_alive > 0) {
+            /* The job was stopped and owns the pipeline from now on */
+            list_remove(&pipe->elem);
+            break;
+        }
+
+        /* Runs that could not be spawned or were interrupted by ^C
+         * end the benchmark and are not measured */
+        bool interrupted = job->numChildren == 0;
+        struct rusage usage;
+        memset(&usage, 0, sizeof usage);
+        for (int i = 0; i < list_size(&pipe->commands); i++) {
+            struct job_proc *proc = &job->procs[i];
+            if (proc->pid == -1)
+                continue;
+            proc_usage_add(&usage, &proc->usage);
+            if (WIFSIGNALED(proc->status) && WTERMSIG(proc->status) == SIGINT)
+                interrupted = true;
+        }
+        if (run >= warmup && !interrupted) {
+            wall[measured++] = elapsed_ms(&job->parsed_at, &job->exited_at);
+            proc_usage_add(&total, &usage);
+        }
+
+        if (job->numChildren > 0)
+            list_remove(&job->done_elem);
+        list_remove(&job->elem);
+        job->pipe = NULL;
+        delete_job(job);
+        if (interrupted)
+            break;
+    }
+
+    if (measured > 0) {
+        qsort(wall, measured, sizeof *wall, compare_double);
+        printf("%d runs, %d warmup\n", measured, warmup);
+        printf("wall\tmin %.3fms median %.3fms p90 %.3fms p99 %.3fms "
+               "max %.3fms\n", wall[0], percentile(wall, measured, 50),
+               percentile(wall, measured, 90), percentile(wall, measured, 99),
+               wall[measured - 1]);
+        printf("cpu\tuser %ld.%03lds sys %ld.%03lds\n",
+               (long) total.ru_utime.tv_sec, (long) total.ru_utime.tv_usec / 1000,
+               (long) total.ru_stime.tv_sec, (long) total.ru_stime.tv_usec / 1000);
+    }
+    free(wall);
+}
+
+/*
+ * ^C while a builtin waits for background jobs.
+ *
+ * The shell keeps the terminal then, so ^C is sent to the shell.  It
+ * is blocked and read from a signalfd for the duration, which sets
+ * 'interrupted'.
+ */
+static struct event_source sigint_ev;
+static bool interrupted;
+
+static void
+sigint_ready(struct event_source *src, uint32_t events)
+{
+    struct signalfd_siginfo fdsi[4];
+    while (read(src->fd, fdsi, sizeof fdsi) > 0)
+        interrupted = true;
+}
+
+static void
+sigint_watch_begin(void)
+{
+    sigint_ev.fd = signal_create_fd(SIGINT);
+    sigint_ev.handler = sigint_ready;
+    event_loop_add(&sigint_ev, EPOLLIN);
+    interrupted = false;
+}
+
+static void
+sigint_watch_end(void)
+{
+    event_loop_remove(&sigint_ev);
+    close(sigint_ev.fd);
+    signal_unblock(SIGINT);
+}
+
+/* The timeout builtin: timeout [-k grace] duration pipeline
+ *
+ * Runs the pipeline as a job with a time limit of 'duration': once it
+ * has run that long, its process group is sent SIGTERM, and 'grace'
+ * later, if any of its processes are left, SIGKILL (see job_time_up()).
+ */
+static void
+timeout_pipeline(struct ast_pipeline *pipe, struct timespec parsed_at)
+{
+    struct ast_command *cmd;
+    cmd = list_entry(list_front(&pipe->commands), struct ast_command, elem);
+
+    int argc = 0;
+    while (cmd->argv[argc])
+        argc++;
+
+    uint64_t time_limit, grace = JOB_KILL_GRACE;
+    bool valid = true;
+    int opt;
+    optind = 0;
+    while ((opt = getopt(argc, cmd->argv, "+k:")) != -1) {
+        if (opt != 'k' || !deadline_parse_duration(optarg, &grace))
+            valid = false;
+    }
+    if (!valid || optind + 1 >= argc
+        || !deadline_parse_duration(cmd->argv[optind], &time_limit)) {
+        fprintf(stderr, "timeout: usage: timeout [-k grace] duration pipeline\n");
+        return;
+    }
+
+    /* Strip 'timeout', its options and the duration off the first command */
+    optind++;
+    for (int i = 0; i < optind; i++)
+        free(cmd->argv[i]);
+    memmove(cmd->argv, cmd->argv + optind,
+            (argc - optind + 1) * sizeof *cmd->argv);
+
+    //The job owns the pipeline from now on
+    list_remove(&pipe->elem);
+    struct job *job = add_job(pipe);
+    job->parsed_at = parsed_at;
+    job->time_limit = time_limit;
+    job->kill_grace = grace;
+    run_job(job);
+}
+
+/* The after builtin: after [--on-success|--always] %jid ... -- pipeline
+ *
+ * Makes the pipeline a PENDING background job that is started once all
+ * the given jobs are done: if they all exited with status 0, or with
+ * --always, however they ended.  Nothing polls for this; each job
+ * counts off its dependents in job_proc_reaped() when its last process
+ * is reaped, and start_ready_jobs() starts those it was the last one
+ * for on the next pass of the event loop.
+ */
+static void
+after_pipeline(struct ast_pipeline *pipe, struct timespec parsed_at)
+{
+    struct ast_command *cmd;
+    cmd = list_entry(list_front(&pipe->commands), struct ast_command, elem);
+
+    int ndeps = 0, dashdash;
+    for (dashdash = 1; cmd->argv[dashdash] != NULL
+                       && strcmp(cmd->argv[dashdash], "--") != 0; dashdash++) {
+        const char *arg = cmd->argv[dashdash];
+        if (strcmp(arg, "--always") == 0 || strcmp(arg, "--on-success") == 0)
+            continue;
+        if (get_job_from_jid(atoi(*arg == '%' ? arg + 1 : arg)) == NULL) {
+            fprintf(stderr, "after: %s: no such job\n", arg);
+            return;
+        }
+        ndeps++;
+    }
+    if (ndeps == 0 || cmd->argv[dashdash] == NULL
+        || cmd->argv[dashdash + 1] == NULL) {
+        fprintf(stderr, "after: usage: after [--on-success|--always] %%jid ... -- pipeline\n");
+        return;
+    }
+
+    //The job owns the pipeline from now on
+    list_remove(&pipe->elem);
+    pipe->bg_job = true;
+    struct job *job = add_job(pipe);
+    job->parsed_at = parsed_at;
+    job->status = PENDING;
+    job->deps = malloc(ndeps * sizeof *job->deps);
+    if (job->deps == NULL)
+        utils_fatal_error("cannot allocate job dependencies: ");
+
+    //Jobs that are done already are not waited for
+    for (int i = 1; i < dashdash; i++) {
+        const char *arg = cmd->argv[i];
+        if (strcmp(arg, "--always") == 0 || strcmp(arg, "--on-success") == 0) {
+            job->run_always = strcmp(arg, "--always") == 0;
+            continue;
+        }
+        struct job *dep = get_job_from_jid(atoi(*arg == '%' ? arg + 1 : arg));
+        if (dep->status != QUEUED && dep->status != PENDING
+            && dep->num_processes_alive == 0) {
+            if (job_failed(dep))
+                job->deps_failed = true;
+            continue;
+        }
+        struct job_dep *edge = &job->deps[job->ndeps++];
+        edge->job = dep;
+        edge->waiter = job;
+        list_push_back(&dep->dependents, &edge->elem);
+        job->deps_left++;
+    }
+    if (job->deps_left == 0)
+        list_push_back(&ready_jobs, &job->ready_elem);
+
+    /* Strip 'after', its arguments and the '--' off the first command */
+    int argc = dashdash + 1;
+    while (cmd->argv[argc])
+        argc++;
+    for (int i = 0; i <= dashdash; i++)
+        free(cmd->argv[i]);
+    memmove(cmd->argv, cmd->argv + dashdash + 1,
+            (argc - dashdash) * sizeof *cmd->argv);
+    fprintf(stderr, "[%d] pending\n", job->jid);
+}
+
+/* Mark 'job' for the wait builtin, or count it off right away if it
+ * has already finished or stopped */
+static void
+wait_add_job(struct job *job)
+{
+    if (job->waited)
+        return;
+    if (job->status == STOPPED || job->status == NEEDSTERMINAL)
+        wait_finished++;
+    else if (job->status != QUEUED && job->status != PENDING
+             && job->num_processes_alive == 0) {
+        wait_finished++;
+        if (job_failed(job))
+            wait_failed++;
+    } else {
+        job->waited = true;
+        wait_outstanding++;
+    }
+}
+
+/* The wait builtin: wait [-n] [%jid ...]
+ *
+ * Waits until the given jobs, or else all running, queued and pending
+ * background jobs, have finished or stopped; with -n, until any one
+ * of them has.  The jobs are marked, and job_proc_reaped() counts
+ * each off when its last process is reaped, so that every wakeup
+ * costs the same however many jobs are waited for.  ^C ends the wait.
+ * The number of jobs that failed is reported at the end.
+ */
+static void
+wait_builtin(char **argv)
+{
+    bool any = argv[1] != NULL && strcmp(argv[1], "-n") == 0;
+    char **arg = argv + 1 + any;
+
+    wait_outstanding = wait_finished = wait_failed = 0;
+    if (*arg == NULL) {
+        for (struct list_elem *e = list_begin(&job_list);
+             e != list_end(&job_list); e = list_next(e)) {
+            struct job *job = list_entry(e, struct job, elem);
+            if (job->status == QUEUED || job->status == PENDING
+                || (job->status == BACKGROUND && job->num_processes_alive > 0))
+                wait_add_job(job);
+        }
+    }
+    for (; *arg != NULL; arg++) {
+        const char *jidarg = **arg == '%' ? *arg + 1 : *arg;
+        struct job *job = get_job_from_jid(atoi(jidarg));
+        if (job == NULL)
+            fprintf(stderr, "wait: %s: no such job\n", *arg);
+        else
+            wait_add_job(job);
+    }
+
+    sigint_watch_begin();
+    for (;;) {
+        drain_child_events();
+        start_ready_jobs();
+        if (wait_outstanding == 0 || (any && wait_finished > 0)
+            || interrupted)
+            break;
+        event_loop_wait(queued_jobs_timeout());
+    }
+    sigint_watch_end();
+
+    //Jobs still running are no longer waited for
+    if (wait_outstanding > 0)
+        for (struct list_elem *e = list_begin(&job_list);
+             e != list_end(&job_list); e = list_next(e))
+            list_entry(e, struct job, elem)->waited = false;
+    if (wait_failed > 0)
+        fprintf(stderr, "wait: %d of %d jobs failed\n",
+                wait_failed, wait_finished);
+}
+
+/* The parallel builtin: parallel [-j jobs] [--tag] [-a file] pipeline
+ *
+ * Runs the pipeline once for each line of 'file', of the file its
+ * input is redirected from, or of what is typed up to ^D, with {} in
+ * its words replaced by the line (see parallel_instance()).  Up to
+ * 'jobs' instances, by default one per online CPU, run at a time,
+ * each as a background job of its own.  With --tag, every line an
+ * instance prints is prefixed with its input line.  ^C interrupts
+ * the running instances and starts no more.  The number of instances
+ * that failed is reported at the end.
+ */
+static void
+parallel_pipeline(struct ast_pipeline *pipe)
+{
+    static const struct option long_options[] = {
+        { "tag", no_argument, NULL, 't' },
+        { NULL, 0, NULL, 0 }
+    };
+    struct ast_command *cmd;
+    cmd = list_entry(list_front(&pipe->commands), struct ast_command, elem);
+
+    int argc = 0;
+    while (cmd->argv[argc])
+        argc++;
+
+    int jobs = sysconf(_SC_NPROCESSORS_ONLN), opt;
+    bool tag = false;
+    const char *file = pipe->iored_input;
+    optind = 0;
+    while ((opt = getopt_long(argc, cmd->argv, "+j:a:", long_options,
+                              NULL)) != -1) {
+        switch (opt) {
+        case 'j':
+            jobs = atoi(optarg);
+            break;
+        case 'a':
+            file = optarg;
+            break;
+        case 't':
+            tag = true;
+            break;
+        default:
+            jobs = 0;
+        }
+    }
+    if (optind == argc || jobs < 1) {
+        fprintf(stderr, "usage: parallel [-j jobs] [--tag] [-a file] pipeline\n");
+        return;
+    }
+
+    sigint_watch_begin();
+
+    size_t nargs = 0;
+    char **args = NULL;
+    FILE *f = file ? fopen(file, "r") : stdin;
+    if (f == NULL)
+        utils_error("parallel: %s: ", file);
+    else {
+        args = parallel_read_lines(f, &nargs);
+        if (f == stdin)
+            clearerr(stdin);
+        else
+            fclose(f);
+    }
+
+    /* Strip 'parallel' and its options off the first command */
+    for (int i = 0; i < optind; i++)
+        free(cmd->argv[i]);
+    memmove(cmd->argv, cmd->argv + optind,
+            (argc - optind + 1) * sizeof *cmd->argv);
+
+    struct parallel_slot {
+        struct job *job;            /* Instance running in it, or NULL */
+        struct tagged_output *out;  /* Its output, if tagged */
+    } *slots = calloc(jobs, sizeof *slots);
+    if (slots == NULL)
+        utils_fatal_error("cannot allocate parallel jobs: ");
+
+    size_t next = 0;
+    int running = 0, failed = 0;
+    bool killed = false;
+    while (running > 0 || (next < nargs && !interrupted)) {
+        for (int s = 0; s < jobs && next < nargs && !interrupted; s++) {
+            if (slots[s].job != NULL)
+                continue;
+
+            struct job *job = add_job(parallel_instance(pipe, args[next]));
+            job->managed = true;
+            clock_gettime(CLOCK_MONOTONIC, &job->parsed_at);
+
+            //An instance whose output cannot be tagged is not run untagged
+            if (tag && (slots[s].out = tagged_output_open(args[next],
+                                                          &job->output_fd)) == NULL) {
+                utils_error("parallel: %s: cannot create pipe: ", args[next]);
+                list_remove(&job->elem);
+                delete_job(job);
+                failed++;
+                next++;
+                continue;
+            }
+            spawn_job(job);
+            if (job->output_fd != -1)
+                close(job->output_fd);
+            slots[s].job = job;
+            running++;
+            next++;
+        }
+
+        /* Collect instances whose processes are gone and whose
+         * output has been printed, or else wait for more events */
+        int collected = 0;
+        for (int s = 0; s < jobs; s++) {
+            struct job *job = slots[s].job;
+            if (job == NULL || job->num_processes_alive > 0
+                || (slots[s].out && !tagged_output_done(slots[s].out)))
+                continue;
+
+            if (job_failed(job))
+                failed++;
+            if (slots[s].out)
+                tagged_output_close(slots[s].out);
+            if (job->numChildren > 0)
+                list_remove(&job->done_elem);
+            list_remove(&job->elem);
+            delete_job(job);
+            slots[s].job = NULL;
+            slots[s].out = NULL;
+            running--;
+            collected++;
+        }
+        //Jobs started with 'after' and queued background jobs keep
+        //going while parallel runs
+        if (collected == 0 && running > 0) {
+            event_loop_wait(queued_jobs_timeout());
+            drain_child_events();
+            start_ready_jobs();
+        }
+
+        /* Interrupt the running instances once, waking stopped ones */
+        if (interrupted && !killed) {
+            for (int s = 0; s < jobs; s++)
+                if (slots[s].job != NULL && slots[s].job->numChildren > 0) {
+                    killpg(slots[s].job->pgid, SIGINT);
+                    killpg(slots[s].job->pgid, SIGCONT);
+                }
+            killed = true;
+        }
+    }
+
+    if (failed > 0)
+        fprintf(stderr, "parallel: %d of %zu jobs failed\n", failed, next);
+    if (next < nargs)
+        fprintf(stderr, "parallel: %zu jobs not started\n", nargs - next);
+
+    for (size_t i = 0; i < nargs; i++)
+        free(args[i]);
+    free(args);
+    free(slots);
+    sigint_watch_end();
+}
+
+/* Every live child holds a pidfd, so the shell takes as many open
+ * files as the hard limit allows rather than stop at the usual soft
+ * limit of 1024 */
+static void
+raise_fd_limit(void)
+{
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        if (setrlimit(RLIMIT_NOFILE, &rl) == -1)
+            utils_error("cannot raise the limit on open files: ");
     }
 }
 
@@ -352,16 +2004,46 @@ main(int ac, char *av[])
     int opt;
 
     /* Process command-line arguments. See getopt(3) */
-    while ((opt = getopt(ac, av, "h")) > 0) {
+    bool use_zygote = false;
+    const char *cgroup_parent = NULL;
+    while ((opt = getopt(ac, av, "hzc:r")) > 0) {
         switch (opt) {
         case 'h':
             usage(av[0]);
             break;
+        case 'z':
+            use_zygote = true;
+            break;
+        case 'c':
+            cgroup_parent = optarg;
+            break;
+        case 'r':
+            if (prctl(PR_SET_CHILD_SUBREAPER, 1) == -1)
+                utils_error("cannot become a child subreaper: ");
+            else
+                subreaper = true;
+            break;
         }
     }
 
+    raise_fd_limit();
+
+    /* Fork the spawner first, while the shell is still small */
+    if (use_zygote && !zygote_start())
+        utils_error("cannot start spawner: ");
+
+    /* Without a usable cgroup, jobs simply run in the shell's */
+    if (cgroup_parent != NULL && !job_cgroup_init(cgroup_parent))
+        utils_error("cannot use cgroup %s, jobs will not be limited: ",
+                    cgroup_parent);
+
     list_init(&job_list);
-    signal_set_handler(SIGCHLD, sigchld_handler);
+    list_init(&done_list);
+    list_init(&queued_jobs);
+    list_init(&ready_jobs);
+    deadline_init(&watchdog_deadline, watchdog_tick);
+    child_monitor_init();
+    stdin_monitor_init();
     termstate_init();
 
     /* Read/eval loop. */
@@ -369,13 +2051,19 @@ main(int ac, char *av[])
     for (;;) {
         
 
-        /* If you fail this assertion, you were about to enter readline()
-         * while SIGCHLD is blocked.  This means that your shell would be
-         * unable to receive SIGCHLD signals, and thus would be unable to
-         * wait for background jobs that may finish while the
-         * shell is sitting at the prompt waiting for user input.
+        /* SIGCHLD stays blocked for the lifetime of the shell; it is
+         * received through a signalfd that the prompt's event loop
+         * monitors along with the children's pidfds.  If you fail
+         * this assertion, stop notifications would be delivered to
+         * the default (ignoring) disposition and lost.
          */
-        assert(!signal_is_blocked(SIGCHLD));
+        assert(signal_is_blocked(SIGCHLD));
+
+        /* Bring the job list up to date with children that changed
+         * state while the last command line was being executed */
+        drain_child_events();
+        reclaim_finished_jobs();
+        start_ready_jobs();
 
         /* If you fail this assertion, you were about to call readline()
          * without having terminal ownership.
@@ -387,16 +2075,19 @@ main(int ac, char *av[])
 
         /* Do not output a prompt unless shell's stdin is a terminal */
         char * prompt = isatty(0) ? build_prompt() : NULL;
-        char * cmdline = readline(prompt);
+        char * cmdline = read_command_line(prompt);
         free (prompt);
 
         if (cmdline == NULL)  /* User typed EOF */
             break;
 
         struct ast_command_line * cline = ast_parse_command_line(cmdline);
-        // free (cmdline);
-        if (cline == NULL)                  /* Error in command line */
+        struct timespec parsed_at;
+        clock_gettime(CLOCK_MONOTONIC, &parsed_at);
+        if (cline == NULL) {                /* Error in command line */
+            free(cmdline);
             continue;
+        }
 
         //History implementation
         char* history;
@@ -411,33 +2102,23 @@ main(int ac, char *av[])
 
         if (list_empty(&cline->pipes)) {    /* User hit enter */
             ast_command_line_free(cline);
+            free(cmdline);
             continue;
         }
-     
-       
 
-        //Loop to check any job with num process alive with 0, and then delete under here
-        struct job * delJob = NULL;
-        struct list_elem * e = list_begin(&job_list);
-        
-        for(; e != list_end(&job_list); e = list_next(e)){
-            struct job *tempJob = list_entry(e, struct job, elem);
-            if(tempJob->num_processes_alive == 0){
-                delJob = tempJob;
-                list_remove(e);
-                break;
-            }
-        }
+        /* Forget cached command locations if PATH or one of its
+         * directories changed since the last command line */
+        path_cache_revalidate();
 
-        if(delJob != NULL){
-            delete_job(delJob);
-        }
 
         //ast_command_line_print(cline);      /* Output a representation of
         //                                       the entered command line */
         struct list_elem* currPipeNode;
+        struct list_elem* nextPipeNode;
 
-        for(currPipeNode = list_begin(&cline->pipes); currPipeNode != list_end(&cline->pipes); currPipeNode=list_next(currPipeNode)){
+        //nextPipeNode is saved up front because a job takes its pipeline out of cline
+        for(currPipeNode = list_begin(&cline->pipes); currPipeNode != list_end(&cline->pipes); currPipeNode=nextPipeNode){
+        nextPipeNode = list_next(currPipeNode);
 
         //Get ast pipeline element using the command line from ^ step
         struct ast_pipeline* currPipe = list_entry(currPipeNode, struct ast_pipeline, elem);
@@ -445,55 +2126,99 @@ main(int ac, char *av[])
         //Get pipe-element 
         struct ast_command* currCmd = list_entry(firstPipeline, struct ast_command, elem);
 
-        int listSize = list_size(&currPipe->commands);
         struct job* currentJob = NULL;
 
         //Each of these commands looks for processes/commands inside of the job
         if (strcmp(currCmd->argv[0], "jobs") == 0){
-            
+
+            //jobs -l also lists the resources used by each process
+            bool longFormat = currCmd->argv[1] != NULL
+                              && strcmp(currCmd->argv[1], "-l") == 0;
             struct list_elem * e = list_begin(&job_list);
-    
+
             for(; e != list_end(&job_list); e = list_next(e))
             {
                 currentJob = list_entry(e, struct job, elem);
-                print_job(currentJob);
+                if (longFormat)
+                    print_job_long(currentJob);
+                else
+                    print_job(currentJob);
             }
         }
 
         else if (strcmp(currCmd->argv[0], "fg") == 0){
 
             //fg <job id> syntax
-            int jobID = atoi(currCmd->argv[1]);
-            currentJob = get_job_from_jid(jobID);
-            currentJob->pipe->bg_job = false;
-            currentJob->status = FOREGROUND;
-            print_cmdline(currentJob->pipe);
-            printf("\n");
-         
-            termstate_give_terminal_to(&currentJob->saved_tty_state, currentJob->pgid);
-            killpg(currentJob->pgid, SIGCONT);
-            signal_block(SIGCHLD);
-            wait_for_job(currentJob);
-            signal_unblock(SIGCHLD);
+            currentJob = get_job_from_argv(currCmd->argv);
+
+            if (currentJob == NULL)
+                ;   //get_job_from_argv() has said why
+            //A pending job runs only once its dependencies are done
+            else if (currentJob->status == PENDING)
+                fprintf(stderr, "fg: job %d is pending\n", currentJob->jid);
+            //A queued job is spawned right away, in the foreground
+            else if (currentJob->status == QUEUED) {
+                print_cmdline(currentJob->pipe);
+                printf("\n");
+                if (start_queued_job(currentJob, false))
+                    wait_for_job(currentJob);
+            }
+            else {
+                currentJob->pipe->bg_job = false;
+                currentJob->status = FOREGROUND;
+                job_update_running(currentJob);
+                print_cmdline(currentJob->pipe);
+                printf("\n");
+
+                job_set_sched(currentJob, false);
+                termstate_give_terminal_to(&currentJob->saved_tty_state, currentJob->pgid);
+                killpg(currentJob->pgid, SIGCONT);
+                wait_for_job(currentJob);
+            }
         }
 
 
         else if (strcmp(currCmd->argv[0], "bg") == 0){
-            int jobID = atoi(currCmd->argv[1]);
-            currentJob = get_job_from_jid(jobID);
-            currentJob->pipe->bg_job = true;
-            currentJob->status = BACKGROUND;
-            print_cmdline(currentJob->pipe);
-            printf("\n");
-
-            termstate_give_terminal_back_to_shell();
-            killpg(currentJob->pgid, SIGCONT);
+            currentJob = get_job_from_argv(currCmd->argv);
+
+            if (currentJob == NULL)
+                ;   //get_job_from_argv() has said why
+            else if (currentJob->status == PENDING)
+                fprintf(stderr, "bg: job %d is pending\n", currentJob->jid);
+            //A queued job is spawned right away, past the limit
+            else if (currentJob->status == QUEUED) {
+                print_cmdline(currentJob->pipe);
+                printf("\n");
+                start_queued_job(currentJob, true);
+            }
+            else {
+                currentJob->pipe->bg_job = true;
+                currentJob->status = BACKGROUND;
+                job_update_running(currentJob);
+                print_cmdline(currentJob->pipe);
+                printf("\n");
+
+                job_set_sched(currentJob, true);
+                termstate_give_terminal_back_to_shell();
+                killpg(currentJob->pgid, SIGCONT);
+            }
         }
 
         else if (strcmp(currCmd->argv[0], "kill") == 0){
-            int jobID = atoi(currCmd->argv[1]);
-            currentJob = get_job_from_jid(jobID);
-            killpg(currentJob->pgid, SIGTERM);
+            currentJob = get_job_from_argv(currCmd->argv);
+
+            if (currentJob == NULL)
+                ;   //get_job_from_argv() has said why
+            //A queued or pending job has no processes yet and simply
+            //goes away; jobs pending on it are cancelled
+            else if (currentJob->status == QUEUED || currentJob->status == PENDING) {
+                if (currentJob->status == QUEUED)
+                    list_remove(&currentJob->queue_elem);
+                list_remove(&currentJob->elem);
+                delete_job(currentJob);
+            }
+            else
+                killpg(currentJob->pgid, SIGTERM);
         }
 
         else if (strcmp(currCmd->argv[0], "exit") == 0){
@@ -502,11 +2227,12 @@ main(int ac, char *av[])
 
         else if (strcmp(currCmd->argv[0], "stop") == 0){
 
-            int jobID = atoi(currCmd->argv[1]);
-            currentJob = get_job_from_jid(jobID);
-            print_job(currentJob);
-
-            killpg(currentJob->pgid, SIGTSTP);
+            currentJob = get_job_from_argv(currCmd->argv);
+            if (currentJob != NULL) {
+                print_job(currentJob);
+                if (currentJob->status != QUEUED && currentJob->status != PENDING)
+                    killpg(currentJob->pgid, SIGTSTP);
+            }
         }
 
         //cd built in 
@@ -521,6 +2247,103 @@ main(int ac, char *av[])
                 utils_error("No such file or directory\n");
             }
         }
+        //hash built in: hash lists, hash -r forgets cached command locations
+        else if (strcmp(currCmd->argv[0], "hash") == 0){
+            if (currCmd->argv[1] != NULL && strcmp(currCmd->argv[1], "-r") == 0)
+                path_cache_clear();
+            else
+                path_cache_print();
+        }
+
+        //placement built in
+        else if (strcmp(currCmd->argv[0], "placement") == 0){
+            enum placement_policy policy;
+            if (currCmd->argv[1] == NULL)
+                placement_print();
+            else if (placement_policy_parse(currCmd->argv[1], &policy))
+                placement_set_policy(policy);
+            else
+                fprintf(stderr, "placement: usage: placement [off|compact|spread]\n");
+        }
+
+        //bgsched built in: how background jobs are scheduled
+        else if (strcmp(currCmd->argv[0], "bgsched") == 0){
+            if (currCmd->argv[1] == NULL)
+                bg_sched_print();
+            else if (!bg_sched_parse(currCmd->argv + 1))
+                fprintf(stderr, "bgsched: usage: bgsched [off|batch|idle] [nice N]\n");
+        }
+
+        //limit built in: limit %jid mem=SIZE cpu=PERCENT% time=DURATION
+        else if (strcmp(currCmd->argv[0], "limit") == 0){
+            const char *jidarg = currCmd->argv[1];
+            if (jidarg != NULL && *jidarg == '%')
+                jidarg++;
+            struct job *job = jidarg ? get_job_from_jid(atoi(jidarg)) : NULL;
+            if (jidarg == NULL || currCmd->argv[2] == NULL)
+                fprintf(stderr, "limit: usage: limit %%jid [mem=SIZE] [cpu=PERCENT%%] [time=DURATION]\n");
+            else if (job == NULL)
+                fprintf(stderr, "limit: %s: no such job\n", currCmd->argv[1]);
+            else
+                for (char **spec = currCmd->argv + 2; *spec; spec++) {
+                    //Time limits are kept by the shell, not the cgroup
+                    if (strncmp(*spec, "time=", 5) == 0) {
+                        if (deadline_parse_duration(*spec + 5, &job->time_limit))
+                            job_arm_deadline(job);
+                        else
+                            fprintf(stderr, "limit: %s: invalid duration\n", *spec);
+                    }
+                    else if (job->cgroup_fd == -1)
+                        fprintf(stderr, "limit: job %d has no cgroup%s\n", job->jid,
+                                job_cgroup_enabled() ? "" : " (start cush with -c)");
+                    else if (!job_cgroup_limit(job->cgroup_fd, *spec))
+                        utils_error("limit: %s: ", *spec);
+                }
+        }
+
+        //bglimit built in: how many background jobs may run at once
+        else if (strcmp(currCmd->argv[0], "bglimit") == 0){
+            if (currCmd->argv[1] == NULL)
+                admission_print();
+            else if (!admission_parse(currCmd->argv + 1))
+                fprintf(stderr, "bglimit: usage: bglimit [N|off] [load=L] [cpu=P%%]\n");
+        }
+
+        //timeout built in
+        else if (strcmp(currCmd->argv[0], "timeout") == 0){
+            timeout_pipeline(currPipe, parsed_at);
+        }
+
+        //watchdog built in: thresholds for runaway jobs
+        else if (strcmp(currCmd->argv[0], "watchdog") == 0){
+            if (currCmd->argv[1] == NULL)
+                watchdog_print();
+            else if (watchdog_parse(currCmd->argv + 1))
+                watchdog_update();
+            else
+                fprintf(stderr, "watchdog: usage: watchdog [off] [every=DURATION] [rss=SIZE] [cpu=DURATION] [action=stop|term|kill]\n");
+        }
+
+        //after built in
+        else if (strcmp(currCmd->argv[0], "after") == 0){
+            after_pipeline(currPipe, parsed_at);
+        }
+
+        //wait built in
+        else if (strcmp(currCmd->argv[0], "wait") == 0){
+            wait_builtin(currCmd->argv);
+        }
+
+        //parallel built in
+        else if (strcmp(currCmd->argv[0], "parallel") == 0){
+            parallel_pipeline(currPipe);
+        }
+
+        //bench built in
+        else if (strcmp(currCmd->argv[0], "bench") == 0){
+            bench_pipeline(currPipe);
+        }
+
         //history built in
         else if(strcmp(currCmd->argv[0], "history") == 0){
             using_history();
@@ -535,180 +2358,28 @@ main(int ac, char *av[])
 
             if(currentJob == NULL)
             {
+                //The job owns the pipeline from now on
+                list_remove(&currPipe->elem);
                 currentJob = add_job(currPipe);
-                currentJob->numChildren = 0;
+                currentJob->parsed_at = parsed_at;
             }
             
-            struct list_elem * e = list_begin (&currPipe->commands); 
-
-            int commandsLeft = listSize;
-            //Initialize file descriptor for first pipe
-            int firstPipeEnds[2];
-            int i = 0;
-
-            //This is the for loop through the pipeline
-            for (; e != list_end (&currPipe->commands); e = list_next(e)) {
-                struct ast_command *currCmd = list_entry(e, struct ast_command, elem);
-                commandsLeft--;
-                i++;
-
-                posix_spawn_file_actions_t child_file_attr;
-                posix_spawnattr_t child_spawn_attr; 
-
-                posix_spawnattr_init(&child_spawn_attr);
-                posix_spawn_file_actions_init(&child_file_attr);
-            
-                //Set process groups
-                if(currentJob->numChildren == 0){
-                    posix_spawnattr_setpgroup(&child_spawn_attr, 0);
-                    posix_spawnattr_setflags(&child_spawn_attr, POSIX_SPAWN_SETPGROUP);
-                }
-                else{
-                    posix_spawnattr_setpgroup(&child_spawn_attr, currentJob->pgid);
-                    posix_spawnattr_setflags(&child_spawn_attr, POSIX_SPAWN_SETPGROUP);
-                }
-                
-                //FOREGROUND
-                if (!currPipe->bg_job) 
-                {
-                    currentJob->status = FOREGROUND;
-                    posix_spawnattr_tcsetpgrp_np(&child_spawn_attr, termstate_get_tty_fd());
-                    posix_spawnattr_setflags(&child_spawn_attr, POSIX_SPAWN_TCSETPGROUP| POSIX_SPAWN_SETPGROUP);
-                }
-                else
-                {   
-                    currentJob->status = BACKGROUND;
-                    posix_spawnattr_tcsetpgrp_np(&child_spawn_attr, termstate_get_tty_fd());
-                    posix_spawnattr_setflags(&child_spawn_attr, POSIX_SPAWN_SETPGROUP);
-                }
-
-                //IO Redirection 
-                 if (currPipe->iored_input != NULL && e == list_begin(&currPipe->commands))//first command
-                {
-                    posix_spawn_file_actions_addopen(&child_file_attr, 0, currPipe->iored_input, O_RDONLY, S_IRWXU | S_IRWXG | S_IRWXO);
-                }
-                if (currPipe->iored_output != NULL && list_next(e) == list_end(&currPipe->commands)) //last command
-                {
-                    int flag = O_CREAT | O_WRONLY;
-                    if (currPipe->append_to_output) {
-                        flag |= O_APPEND;
-                    } else {
-                        flag |= O_TRUNC;
-                    }
-                    posix_spawn_file_actions_addopen(&child_file_attr, 1, currPipe->iored_output, flag, S_IRWXU | S_IRWXG | S_IRWXO);
-                }
-                
-                //Initialize second 2D pipe array
-                int secondPipeEnds[2]; 
-                //More than one command
-                if (listSize > 1)
-                {
-                    // Piping implementation
-                    if (e == list_begin(&currPipe->commands))
-                    {   
-                        pipe2(firstPipeEnds, O_CLOEXEC);
-                        posix_spawn_file_actions_adddup2(&child_file_attr, firstPipeEnds[1], 1);
-                    }
-                    else if (list_next(e) == list_end(&currPipe->commands)) 
-                    {
-                        posix_spawn_file_actions_adddup2(&child_file_attr, firstPipeEnds[0], 0);
-                    } 
-                    else
-                    {
-                        pipe2(secondPipeEnds, O_CLOEXEC);
-                        posix_spawn_file_actions_adddup2(&child_file_attr, firstPipeEnds[0], 0);
-                        posix_spawn_file_actions_adddup2(&child_file_attr, secondPipeEnds[1], 1);
-                    }            
-                }
-
-                if (currCmd->dup_stderr_to_stdout)
-                {
-                    posix_spawn_file_actions_adddup2(&child_file_attr, 1, 2);
-                }
-
-                int pid;
-                int spawned = posix_spawnp(&pid,  currCmd->argv[0],&child_file_attr, &child_spawn_attr, currCmd->argv, environ);
-
-                //Need to close pipes
-                if (listSize > 1)
-                {
-                    //First process, list begin
-                    if(i == 1)
-                    {
-                        close(firstPipeEnds[1]);
-                    }
-                    //Middle process
-                    if((i != 1) & (i != listSize)){
-                        close(secondPipeEnds[1]);
-                        close(firstPipeEnds[0]);
-                        firstPipeEnds[0] = secondPipeEnds[0];
-                    }
-                    //Last process, list end
-                    if(i == listSize){
-                        close(firstPipeEnds[0]);
-                    }
-                }
-                //Check if posix spawn return 0
-                if(spawned == 0){
-
-                    if(currentJob->numChildren == 0){
-                        currentJob->pgid = pid;
-                        currentJob->pid = pid;
-                    }
-
-                    currentJob->numChildren++;
-                    currentJob->num_processes_alive++;
-                    if (currPipe->bg_job)
-                    {
-                        fprintf(stderr, "[%d] %d\n", currentJob->jid, currentJob->pgid);
-                        termstate_save(&currentJob->saved_tty_state);
-                    }
-                    
-                }
-                //Invalid command, delete from job list
-                else{
-                    struct job * delJob = NULL;
-                    struct list_elem * e = list_begin(&job_list);
-
-                    for(; e != list_end(&job_list); e = list_next(e)){
-                        struct job *tempJob = list_entry(e, struct job, elem);
-                        if(tempJob->pid == currentJob->pid){
-                            delJob = tempJob;
-                            list_remove(e);
-                            break;
-                        }
-                    }
-                    if(delJob != NULL){
-                        delete_job(delJob);
-                    }
-                    utils_error("No such file or directory\n");
-                }
-               
-            }
-                if (!currPipe->bg_job)
-                {
-
-                    signal_block(SIGCHLD);
-                    wait_for_job(currentJob);
-                    signal_unblock(SIGCHLD);
-                }
+            run_job(currentJob);
             
         }
 
-        /* Free the command line.
-         * This will free the ast_pipeline objects still contained
-         * in the ast_command_line.  Once you implement a job list
-         * that may take ownership of ast_pipeline objects that are
-         * associated with jobs you will need to reconsider how you
-         * manage the lifetime of the associated ast_picpelines.
-         * Otherwise, freeing here will cause use-after-free errors.
-         */
-
-        //ast_command_line_free(cline);
         termstate_give_terminal_back_to_shell();
 
         }
 
+        /* Free the command line.
+         * This frees the ast_pipeline objects still contained in the
+         * ast_command_line, i.e., those of builtins.  Pipelines that
+         * became jobs were taken out of it and are freed along with
+         * their job by delete_job().
+         */
+        ast_command_line_free(cline);
+        free(cmdline);
     }
 
     return 0;
@@ -1,3 +1,19 @@
 = Tests for Custom Features
 1 cd_tests.py
-1 history_tests.py
\ No newline at end of file
+1 history_tests.py
+1 done_tests.py
+1 jobs_long_tests.py
+1 time_tests.py
+1 bench_tests.py
+1 hash_tests.py
+1 zygote_tests.py
+1 placement_tests.py
+1 bgsched_tests.py
+1 cgroup_tests.py
+1 parallel_tests.py
+1 bglimit_tests.py
+1 wait_tests.py
+1 after_tests.py
+1 timeout_tests.py
+1 watchdog_tests.py
+1 subreaper_tests.py
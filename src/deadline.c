@@ -0,0 +1,192 @@
+/*
+ * A min-heap of deadlines ordered by expiry.
+ *
+ * Each deadline records its position in the heap, so that one can be
+ * cancelled or moved without searching for it.  The timerfd is set to
+ * the root with TFD_TIMER_ABSTIME whenever the root changes.
+ */
+#define _GNU_SOURCE    1
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/timerfd.h>
+
+#include "deadline.h"
+#include "event_loop.h"
+#include "utils.h"
+
+#define NSEC_PER_SEC 1000000000ull
+
+static struct deadline **heap;
+static int nheap, heap_capacity;
+static struct event_source timer_ev = { .fd = -1 };
+static bool expiring;        /* the timerfd is set once expiry is done */
+
+uint64_t
+deadline_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * NSEC_PER_SEC + now.tv_nsec;
+}
+
+static void
+heap_place(struct deadline *d, int i)
+{
+    heap[i] = d;
+    d->index = i;
+}
+
+static void
+sift_up(int i)
+{
+    struct deadline *d = heap[i];
+    while (i > 0 && heap[(i - 1) / 2]->when > d->when) {
+        heap_place(heap[(i - 1) / 2], i);
+        i = (i - 1) / 2;
+    }
+    heap_place(d, i);
+}
+
+static void
+sift_down(int i)
+{
+    struct deadline *d = heap[i];
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= nheap)
+            break;
+        if (child + 1 < nheap && heap[child + 1]->when < heap[child]->when)
+            child++;
+        if (heap[child]->when >= d->when)
+            break;
+        heap_place(heap[child], i);
+        i = child;
+    }
+    heap_place(d, i);
+}
+
+/* Arm the timerfd for the earliest deadline, or disarm it */
+static void
+timer_update(void)
+{
+    if (expiring)
+        return;
+
+    struct itimerspec its = { { 0, 0 }, { 0, 0 } };
+    if (nheap > 0) {
+        //A zero it_value would disarm the timer
+        uint64_t when = heap[0]->when ? heap[0]->when : 1;
+        its.it_value.tv_sec = when / NSEC_PER_SEC;
+        its.it_value.tv_nsec = when % NSEC_PER_SEC;
+    }
+    if (timerfd_settime(timer_ev.fd, TFD_TIMER_ABSTIME, &its, NULL) == -1)
+        utils_fatal_error("timerfd_settime: ");
+}
+
+static void
+timer_ready(struct event_source *src, uint32_t events)
+{
+    uint64_t expirations;
+    if (read(src->fd, &expirations, sizeof expirations) == -1)
+        return;     // it was set again since it became ready
+
+    //Handlers may set deadlines, including the one that expired
+    uint64_t now = deadline_now();
+    expiring = true;
+    while (nheap > 0 && heap[0]->when <= now) {
+        struct deadline *d = heap[0];
+        deadline_cancel(d);
+        d->handler(d);
+    }
+    expiring = false;
+    timer_update();
+}
+
+void
+deadline_init(struct deadline *d, deadline_handler_t handler)
+{
+    d->index = -1;
+    d->handler = handler;
+}
+
+void
+deadline_set(struct deadline *d, uint64_t when)
+{
+    if (timer_ev.fd == -1) {
+        timer_ev.fd = timerfd_create(CLOCK_MONOTONIC,
+                                     TFD_NONBLOCK | TFD_CLOEXEC);
+        if (timer_ev.fd == -1)
+            utils_fatal_error("timerfd_create: ");
+        timer_ev.handler = timer_ready;
+        event_loop_add(&timer_ev, EPOLLIN);
+    }
+
+    if (d->index == -1) {
+        if (nheap == heap_capacity) {
+            heap_capacity = heap_capacity ? 2 * heap_capacity : 64;
+            heap = realloc(heap, heap_capacity * sizeof *heap);
+            if (heap == NULL)
+                utils_fatal_error("cannot grow deadline heap: ");
+        }
+        d->when = when;
+        heap_place(d, nheap++);
+        sift_up(d->index);
+    } else {
+        uint64_t old = d->when;
+        d->when = when;
+        if (when < old)
+            sift_up(d->index);
+        else
+            sift_down(d->index);
+    }
+    if (heap[0] == d)
+        timer_update();
+}
+
+void
+deadline_cancel(struct deadline *d)
+{
+    int i = d->index;
+    if (i == -1)
+        return;
+    d->index = -1;
+
+    struct deadline *last = heap[--nheap];
+    if (i < nheap) {
+        heap_place(last, i);
+        if (i > 0 && heap[(i - 1) / 2]->when > last->when)
+            sift_up(i);
+        else
+            sift_down(i);
+    }
+    if (i == 0)
+        timer_update();
+}
+
+bool
+deadline_parse_duration(const char *s, uint64_t *ns)
+{
+    char *end;
+    double value = strtod(s, &end);
+    if (end == s || !(value >= 0))
+        return false;
+
+    static const struct {
+        const char *suffix;
+        double scale;
+    } units[] = {
+        { "", 1e9 }, { "s", 1e9 }, { "ms", 1e6 }, { "m", 60e9 }, { "h", 3600e9 },
+    };
+    for (int i = 0; i < sizeof units / sizeof units[0]; i++)
+        if (strcmp(end, units[i].suffix) == 0) {
+            //Allow up to about 290 years, leaving room to add it to now
+            if (value * units[i].scale >= 9e18)
+                return false;
+            *ns = value * units[i].scale;
+            return true;
+        }
+    return false;
+}
@@ -0,0 +1,52 @@
+#ifndef __DEADLINE_H
+#define __DEADLINE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Deadlines on CLOCK_MONOTONIC, kept in a binary min-heap and
+ * serviced by a single timerfd that the event loop monitors.
+ *
+ * The timerfd is always armed for the earliest deadline, so the shell
+ * wakes up only when one expires, and setting or cancelling one costs
+ * O(log n) however many are pending.
+ */
+struct deadline;
+
+/* Called when the deadline expires.  It is no longer armed then and
+ * may be set again. */
+typedef void (*deadline_handler_t)(struct deadline *d);
+
+/* Embed this in the structure the deadline belongs to and use
+ * deadline_entry() in the handler to get back to it. */
+struct deadline {
+    uint64_t when;              /* Expiry, in ns of CLOCK_MONOTONIC */
+    int index;                  /* Position in the heap, -1 if not armed */
+    deadline_handler_t handler;
+};
+
+/* Converts pointer to deadline D into a pointer to the structure
+   STRUCT it is embedded in as member MEMBER. */
+#define deadline_entry(D, STRUCT, MEMBER)               \
+        ((STRUCT *) ((uint8_t *) (D) - offsetof (STRUCT, MEMBER)))
+
+/* Initialize 'd' as not armed */
+void deadline_init(struct deadline *d, deadline_handler_t handler);
+
+/* Arm 'd' to expire at 'when', or move it there if it is armed */
+void deadline_set(struct deadline *d, uint64_t when);
+
+/* Disarm 'd' if it is armed */
+void deadline_cancel(struct deadline *d);
+
+/* Return the current CLOCK_MONOTONIC time in ns */
+uint64_t deadline_now(void);
+
+/* Parse a duration such as "10", "1.5s", "250ms", "2m" or "1h", where
+ * seconds are the default unit, into '*ns'.  Returns false if it is
+ * invalid. */
+bool deadline_parse_duration(const char *s, uint64_t *ns);
+
+#endif /* __DEADLINE_H */
@@ -0,0 +1,57 @@
+#!/usr/bin/python
+#
+# Tests that finished background jobs are reported and reclaimed
+# all at once, even while the shell is idle at the prompt, and that
+# the shell can watch more children than its inherited soft limit on
+# open files would allow pidfds for.
+#
+import atexit, proc_check, time, resource
+from testutils import *
+
+# start the shell with a soft limit far below what it needs
+(soft, hard) = resource.getrlimit(resource.RLIMIT_NOFILE)
+lowered = hard == resource.RLIM_INFINITY or hard > 100
+if lowered:
+    resource.setrlimit(resource.RLIMIT_NOFILE, (40, hard))
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+# start three short background jobs on one command line
+sendline("sleep 0.5 & sleep 0.5 & sleep 0.5 &")
+parse_bg_status()
+parse_bg_status()
+parse_bg_status()
+expect_prompt()
+
+# each of them is reported without the user pressing Enter
+expect("Done", "first job not reported")
+expect("Done", "second job not reported")
+expect("Done", "third job not reported")
+
+# and all of them are gone from the job list
+run_builtin('jobs')
+expect_exact("jobs\r\n")
+expect_prompt("jobs still listed after they were reported")
+assert "sleep" not in console.before, "finished jobs still listed"
+
+# each live child holds a pidfd; the shell raised its soft limit
+if lowered:
+    for i in range(45):
+        sendline("sleep 5 &")
+        parse_bg_status()
+        expect_prompt()
+        assert "Too many open files" not in console.before, \
+            "shell ran out of descriptors"
+    time.sleep(6)
+    run_builtin('jobs')
+    expect_exact("jobs\r\n")
+    expect_prompt("jobs still listed after they were reported")
+    assert "sleep" not in console.before, "finished jobs still listed"
+
+sendline("exit")
+expect_exact("exit\r\n", "Shell output extraneous characters")
+
+test_success()
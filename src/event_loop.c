@@ -0,0 +1,70 @@
+/*
+ * Event loop built on epoll.
+ *
+ * Every event source carries its own handler, so the loop itself
+ * knows nothing about jobs, signals or the terminal.  Dispatch cost
+ * is proportional to the number of ready sources, not to the number
+ * of sources registered.
+ */
+#include <errno.h>
+#include <unistd.h>
+#include <assert.h>
+
+#include "event_loop.h"
+#include "utils.h"
+
+#define MAX_EVENTS 64
+
+static int epoll_fd = -1;
+
+void
+event_loop_init(void)
+{
+    assert(epoll_fd == -1 || !!!"event_loop_init already called");
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd == -1)
+        utils_fatal_error("epoll_create1 failed: ");
+}
+
+void
+event_loop_add(struct event_source *src, uint32_t events)
+{
+    struct epoll_event ev = { .events = events, .data.ptr = src };
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, src->fd, &ev) == -1)
+        utils_fatal_error("epoll_ctl add fd %d failed: ", src->fd);
+}
+
+void
+event_loop_modify(struct event_source *src, uint32_t events)
+{
+    struct epoll_event ev = { .events = events, .data.ptr = src };
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, src->fd, &ev) == -1)
+        utils_fatal_error("epoll_ctl modify fd %d failed: ", src->fd);
+}
+
+void
+event_loop_remove(struct event_source *src)
+{
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_DEL, src->fd, NULL) == -1)
+        utils_error("epoll_ctl delete fd %d failed: ", src->fd);
+}
+
+int
+event_loop_wait(int timeout)
+{
+    struct epoll_event events[MAX_EVENTS];
+
+    int n = epoll_wait(epoll_fd, events, MAX_EVENTS, timeout);
+    if (n == -1) {
+        if (errno != EINTR)
+            utils_fatal_error("epoll_wait failed: ");
+        return -1;
+    }
+
+    for (int i = 0; i < n; i++) {
+        struct event_source *src = events[i].data.ptr;
+        src->handler(src, events[i].events);
+    }
+    return n;
+}
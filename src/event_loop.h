@@ -0,0 +1,51 @@
+#ifndef __EVENT_LOOP_H
+#define __EVENT_LOOP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+
+/*
+ * A minimal epoll-based event loop.
+ *
+ * The shell registers a file descriptor per event source (a pidfd
+ * for each child process, a signalfd for SIGCHLD, the terminal) and
+ * blocks in event_loop_wait() until one of them becomes ready.
+ * Ready sources are dispatched to their handler.
+ */
+struct event_source;
+
+/* Called with the epoll event mask that became ready */
+typedef void (*event_handler_t)(struct event_source *src, uint32_t events);
+
+/* Embed this in the structure the event belongs to and use
+ * event_source_entry() in the handler to get back to it. */
+struct event_source {
+    int fd;                     /* File descriptor to monitor */
+    event_handler_t handler;    /* Invoked when fd becomes ready */
+};
+
+/* Converts pointer to event source SRC into a pointer to the
+   structure STRUCT it is embedded in as member MEMBER. */
+#define event_source_entry(SRC, STRUCT, MEMBER)         \
+        ((STRUCT *) ((uint8_t *) (SRC) - offsetof (STRUCT, MEMBER)))
+
+/* Create the epoll instance.  Must be called before any other function. */
+void event_loop_init(void);
+
+/* Start monitoring src->fd for 'events' (EPOLLIN, EPOLLONESHOT, ...) */
+void event_loop_add(struct event_source *src, uint32_t events);
+
+/* Change the events monitored for src, re-arming an EPOLLONESHOT source */
+void event_loop_modify(struct event_source *src, uint32_t events);
+
+/* Stop monitoring src->fd.  The fd is not closed. */
+void event_loop_remove(struct event_source *src);
+
+/* Wait at most 'timeout' milliseconds (-1 for no limit) for events
+ * and dispatch them.  Returns the number of events dispatched, or
+ * -1 with errno set to EINTR if a signal handler interrupted the wait.
+ */
+int event_loop_wait(int timeout);
+
+#endif /* __EVENT_LOOP_H */
@@ -0,0 +1,66 @@
+#!/usr/bin/python
+#
+# Tests the path cache: commands are looked up once, failed lookups
+# are remembered, and the cache notices when a PATH directory changes.
+#
+import atexit, proc_check, time
+from testutils import *
+
+# put a directory we control first in the shell's PATH
+bindir = tempfile.mkdtemp()
+atexit.register(shutil.rmtree, bindir)
+os.environ['PATH'] = bindir + ':' + os.environ['PATH']
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+sendline("hash")
+expect_exact("hash table empty", "cache not empty at startup")
+expect_prompt()
+
+# a command that does not exist yet is remembered as not found
+sendline("cush-hash-test")
+expect("No such file or directory", "missing command was run")
+expect_prompt()
+
+sendline("hash")
+expect(r"1\s+cush-hash-test \(not found\)", "failed lookup not cached")
+expect_prompt()
+
+# creating it changes the directory's mtime, which invalidates the cache
+script = os.path.join(bindir, "cush-hash-test")
+with open(script, "w") as f:
+    f.write("#!/bin/sh\necho hash test ran\n")
+os.chmod(script, 0755)
+
+sendline("cush-hash-test")
+expect_exact("hash test ran", "new command not found after PATH changed")
+expect_prompt()
+
+sendline("hash")
+expect(r"1\s+" + re.escape(script), "resolved path not cached")
+expect_prompt()
+
+# hash -r forgets everything
+sendline("hash -r")
+expect_prompt()
+sendline("hash")
+expect_exact("hash table empty", "hash -r did not empty the cache")
+expect_prompt()
+
+# a script without a #! line is run by /bin/sh, as execvp() would
+script = os.path.join(bindir, "cush-hash-noshebang")
+with open(script, "w") as f:
+    f.write("echo no shebang $1\n")
+os.chmod(script, 0755)
+
+sendline("cush-hash-noshebang ran")
+expect_exact("no shebang ran", "script without #! was not run by /bin/sh")
+expect_prompt()
+
+sendline("exit")
+expect_exact("exit\r\n", "Shell output extraneous characters")
+
+test_success()
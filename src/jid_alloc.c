@@ -0,0 +1,106 @@
+/*
+ * Job id allocator.
+ *
+ * A two-level bitmap: bit i of 'used' is set if id i is taken, and
+ * bit w of 'full' is set if used word w has no free bits left.
+ * Finding the smallest free id scans 'full' for the first word with
+ * a zero bit and then uses a count-trailing-zeros on that word, so
+ * 4096 ids are skipped per summary word examined.
+ *
+ * 'top' follows the highest word that has an id in use.  Since ids
+ * are handed out lowest first, it moves up at most one word per
+ * allocation, so moving it down as words empty is amortized O(1).
+ * Once it falls to a quarter of the bitmap, the bitmap is halved, so
+ * memory follows the ids in use rather than the largest ever used.
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "jid_alloc.h"
+#include "utils.h"
+
+#define BITS 64
+
+static uint64_t *used;          /* One bit per id */
+static uint64_t *full;          /* One bit per word of 'used' */
+static size_t nwords;           /* Number of words in 'used' */
+static size_t top;              /* 1 + the highest word with an id in use */
+
+/* Resize the bitmaps to 'newwords' words of 'used'.  Words beyond
+ * 'top' are not in use, so shrinking drops no ids. */
+static void
+jid_resize(size_t newwords)
+{
+    size_t oldsum = (nwords + BITS - 1) / BITS;
+    size_t newsum = (newwords + BITS - 1) / BITS;
+
+    used = realloc(used, newwords * sizeof *used);
+    full = realloc(full, newsum * sizeof *full);
+    if (used == NULL || full == NULL)
+        utils_fatal_error("cannot resize job id bitmap: ");
+
+    if (newwords > nwords) {
+        memset(used + nwords, 0, (newwords - nwords) * sizeof *used);
+        memset(full + oldsum, 0, (newsum - oldsum) * sizeof *full);
+    } else if (newwords % BITS != 0)
+        //Words past the end may not be marked full in the last summary
+        full[newsum - 1] &= (1ULL << (newwords % BITS)) - 1;
+    if (nwords == 0) {
+        used[0] = 1;            /* job id 0 is never handed out */
+        top = 1;
+    }
+    nwords = newwords;
+}
+
+int
+jid_alloc(void)
+{
+    for (;;) {
+        size_t nsum = (nwords + BITS - 1) / BITS;
+        for (size_t s = 0; s < nsum; s++) {
+            if (full[s] == UINT64_MAX)
+                continue;
+
+            size_t w = s * BITS + __builtin_ctzll(~full[s]);
+            if (w >= nwords)
+                break;
+
+            int bit = __builtin_ctzll(~used[w]);
+            used[w] |= 1ULL << bit;
+            if (used[w] == UINT64_MAX)
+                full[s] |= 1ULL << (w % BITS);
+            if (w >= top)
+                top = w + 1;
+
+            return w * BITS + bit;
+        }
+        jid_resize(nwords ? 2 * nwords : 1);
+    }
+}
+
+void
+jid_free(int jid)
+{
+    assert(jid > 0 && (size_t) jid < nwords * BITS);
+    size_t w = jid / BITS;
+    assert(used[w] & (1ULL << (jid % BITS)));
+
+    used[w] &= ~(1ULL << (jid % BITS));
+    full[w / BITS] &= ~(1ULL << (w % BITS));
+
+    //Word 0 always holds the reserved id 0, so top stays >= 1
+    while (used[top - 1] == 0)
+        top--;
+    while (nwords > 1 && top <= nwords / 4)
+        jid_resize(nwords / 2);
+}
+
+int
+jid_limit(void)
+{
+    if (top == 0)
+        return 1;
+    return (top - 1) * BITS + (BITS - __builtin_clzll(used[top - 1]));
+}
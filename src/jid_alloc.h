@@ -0,0 +1,21 @@
+#ifndef __JID_ALLOC_H
+#define __JID_ALLOC_H
+
+/*
+ * Allocator for job ids.
+ *
+ * Like bash, always hands out the smallest job id that is not in
+ * use, starting at 1.  Allocation and release take (nearly) constant
+ * time, and memory follows the largest id in use.
+ */
+
+/* Return the smallest unused job id (>= 1) and mark it in use */
+int jid_alloc(void);
+
+/* Return a job id obtained from jid_alloc() */
+void jid_free(int jid);
+
+/* Return one more than the largest job id in use, or 1 if none is */
+int jid_limit(void);
+
+#endif /* __JID_ALLOC_H */
@@ -0,0 +1,236 @@
+/*
+ * Per-job cgroups under a delegated cgroup v2 directory.
+ *
+ * The memory and cpu controllers are enabled for the children of the
+ * directory if the kernel offers them there.  If it does not, jobs
+ * still get cgroups and their pressure can be read, but limits on
+ * them fail.
+ */
+#define _GNU_SOURCE    1
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "job_cgroup.h"
+#include "utils.h"
+
+static int parent_fd = -1;      /* The delegated directory */
+
+/* Write 's' to the file 'name' in the cgroup 'dirfd' */
+static bool
+write_file(int dirfd, const char *name, const char *s)
+{
+    int fd = openat(dirfd, name, O_WRONLY | O_CLOEXEC);
+    if (fd == -1)
+        return false;
+    ssize_t n = write(fd, s, strlen(s));
+    int error = errno;
+    close(fd);
+    errno = error;
+    return n == (ssize_t) strlen(s);
+}
+
+bool
+job_cgroup_init(const char *parent)
+{
+    int fd = open(parent, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1)
+        return false;
+
+    //Only cgroup v2 directories have cgroup.subtree_control
+    if (faccessat(fd, "cgroup.subtree_control", W_OK, 0) == -1) {
+        int error = errno == ENOENT ? ENOTSUP : errno;
+        close(fd);
+        errno = error;
+        return false;
+    }
+
+    //Not every controller may be available; each is tried on its own
+    write_file(fd, "cgroup.subtree_control", "+memory");
+    write_file(fd, "cgroup.subtree_control", "+cpu");
+    parent_fd = fd;
+    return true;
+}
+
+bool
+job_cgroup_enabled(void)
+{
+    return parent_fd != -1;
+}
+
+/* Return true if the cgroup 'dirfd' has no processes, in it or below */
+static bool
+is_empty(int dirfd)
+{
+    char buf[256];
+    int fd = openat(dirfd, "cgroup.events", O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return false;
+    ssize_t n = read(fd, buf, sizeof buf - 1);
+    close(fd);
+    if (n <= 0)
+        return false;
+    buf[n] = '\0';
+    return strstr(buf, "populated 0") != NULL;
+}
+
+/* Lift the limits an earlier job may have put on the cgroup 'dirfd'.
+ * A controller that is not enabled has no file to reset. */
+static void
+reset_limits(int dirfd)
+{
+    write_file(dirfd, "memory.max", "max");
+    write_file(dirfd, "cpu.max", "max 100000");
+    write_file(dirfd, "pids.max", "max");
+}
+
+int
+job_cgroup_create(int jid)
+{
+    if (parent_fd == -1)
+        return -1;
+
+    //A cgroup left behind by an earlier job or shell is reused only if
+    //it is empty.  Descendants that outlived that job keep it busy, and
+    //the job then gets a fresh name such as job3.1 instead.
+    for (int i = 0; i < 100; i++) {
+        char name[32];
+        if (i == 0)
+            snprintf(name, sizeof name, "job%d", jid);
+        else
+            snprintf(name, sizeof name, "job%d.%d", jid, i);
+
+        bool created = mkdirat(parent_fd, name, 0755) == 0;
+        if (!created && errno != EEXIST) {
+            utils_error("cannot create cgroup for job %d: ", jid);
+            return -1;
+        }
+        int fd = openat(parent_fd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd == -1) {
+            utils_error("cannot open cgroup for job %d: ", jid);
+            return -1;
+        }
+        if (created)
+            return fd;
+        if (is_empty(fd)) {
+            reset_limits(fd);
+            return fd;
+        }
+        close(fd);
+    }
+    fprintf(stderr, "cannot create cgroup for job %d: all names are busy\n", jid);
+    return -1;
+}
+
+void
+job_cgroup_destroy(int fd)
+{
+    if (fd == -1)
+        return;
+
+    //The name may not be job<jid>; it is found through the descriptor
+    char link[32], path[PATH_MAX];
+    snprintf(link, sizeof link, "/proc/self/fd/%d", fd);
+    ssize_t n = readlink(link, path, sizeof path - 1);
+    close(fd);
+    if (n <= 0)
+        return;
+    path[n] = '\0';
+
+    //Descendants that outlived the job keep it busy; it is left then
+    const char *name = strrchr(path, '/');
+    unlinkat(parent_fd, name != NULL ? name + 1 : path, AT_REMOVEDIR);
+}
+
+/* Write the limit 'value' to 'name', failing with ENOTSUP if the
+ * controller that provides it is not enabled */
+static bool
+write_limit(int dirfd, const char *name, const char *value)
+{
+    if (write_file(dirfd, name, value))
+        return true;
+    if (errno == ENOENT)
+        errno = ENOTSUP;
+    return false;
+}
+
+bool
+job_cgroup_limit(int fd, const char *spec)
+{
+    char value[64];
+
+    if (strncmp(spec, "mem=", 4) == 0) {
+        uint64_t bytes;
+        const char *s = spec + 4;
+        if (strcmp(s, "max") == 0)
+            strcpy(value, "max");
+        else if (utils_parse_size(s, &bytes))
+            snprintf(value, sizeof value, "%llu", (unsigned long long) bytes);
+        else
+            goto invalid;
+        return write_limit(fd, "memory.max", value);
+    }
+
+    if (strncmp(spec, "cpu=", 4) == 0) {
+        //A quota in percent of one CPU, per period of 100ms
+        const char *s = spec + 4;
+        char *end;
+        long percent = strtol(s, &end, 10);
+        if (strcmp(s, "max") == 0)
+            strcpy(value, "max 100000");
+        else if (end != s && strcmp(end, "%") == 0 && percent > 0
+                 && percent <= 100000)
+            snprintf(value, sizeof value, "%ld 100000", percent * 1000);
+        else
+            goto invalid;
+        return write_limit(fd, "cpu.max", value);
+    }
+
+invalid:
+    errno = EINVAL;
+    return false;
+}
+
+/* Print the avg10 figures of the "some" and "full" lines of the
+ * pressure file 'name', or "-" if it cannot be read */
+static void
+print_pressure(int dirfd, const char *name)
+{
+    char buf[256];
+    double some = 0, full = 0;
+    bool have_some = false, have_full = false;
+
+    int fd = openat(dirfd, name, O_RDONLY | O_CLOEXEC);
+    if (fd != -1) {
+        ssize_t n = read(fd, buf, sizeof buf - 1);
+        close(fd);
+        if (n > 0) {
+            buf[n] = '\0';
+            char *full_line = strstr(buf, "full ");
+            have_some = sscanf(buf, "some avg10=%lf", &some) == 1;
+            have_full = full_line != NULL
+                        && sscanf(full_line, "full avg10=%lf", &full) == 1;
+        }
+    }
+    if (have_some)
+        printf(" some %.2f%%", some);
+    else
+        printf(" some -");
+    if (have_full)
+        printf(" full %.2f%%", full);
+}
+
+void
+job_cgroup_print_pressure(int fd)
+{
+    printf("\tpressure\tcpu");
+    print_pressure(fd, "cpu.pressure");
+    printf("\tmemory");
+    print_pressure(fd, "memory.pressure");
+    printf("\n");
+}
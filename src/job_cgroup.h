@@ -0,0 +1,41 @@
+#ifndef __JOB_CGROUP_H
+#define __JOB_CGROUP_H
+
+#include <stdbool.h>
+
+/*
+ * A cgroup v2 per job, so that limits can be put on jobs and their
+ * resource pressure observed.
+ *
+ * The shell is given a cgroup v2 directory that has been delegated to
+ * it (cush -c dir) and creates a child 'job<jid>' in it for each job,
+ * or 'job<jid>.<n>' while processes of an earlier job still occupy it.
+ * The processes of the job are spawned straight into that cgroup with
+ * CLONE_INTO_CGROUP.  Without a usable directory, jobs run in the
+ * shell's cgroup as before.
+ */
+
+/* Use 'parent' for the cgroups of jobs.  Returns false, with errno
+ * set, if it is not a cgroup v2 directory the shell can use. */
+bool job_cgroup_init(const char *parent);
+
+/* Return true if jobs get cgroups */
+bool job_cgroup_enabled(void);
+
+/* Create the cgroup for job 'jid' and return a descriptor for its
+ * directory, or -1 if jobs do not get cgroups or it could not be
+ * created. */
+int job_cgroup_create(int jid);
+
+/* Remove the cgroup whose descriptor is 'fd' once its job is gone */
+void job_cgroup_destroy(int fd);
+
+/* Apply a limit such as "mem=2G" or "cpu=150%" to the cgroup 'fd'.
+ * Returns false, with errno set, if the limit is invalid (EINVAL) or
+ * the controller is not available. */
+bool job_cgroup_limit(int fd, const char *spec);
+
+/* Print the CPU and memory pressure of the cgroup 'fd' on one line */
+void job_cgroup_print_pressure(int fd);
+
+#endif /* __JOB_CGROUP_H */
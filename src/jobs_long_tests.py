@@ -0,0 +1,37 @@
+#!/usr/bin/python
+#
+# Tests that 'jobs -l' lists the resources used by each process
+# of a job, and their total.
+#
+import atexit, proc_check, time
+from testutils import *
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+# a pipeline whose first stage exits while the second keeps running
+sendline("true | sleep 2 &")
+parse_bg_status()
+parse_bg_status()
+expect_prompt()
+time.sleep(0.5)
+
+sendline('jobs -l')
+expect_exact("jobs -l\r\n")
+expect(r"\[\d+\]\s+Running\s+\(true ?\| sleep 2\)", "job not listed")
+expect(r"\d+\s+exited\s+user \d+\.\d{3}s sys \d+\.\d{3}s maxrss \d+K"
+       r" csw \d+/\d+ flt \d+/\d+\s+true",
+       "usage of reaped process not listed")
+expect(r"\d+\s+running\s+user \d+\.\d{3}s sys \d+\.\d{3}s maxrss \d+K"
+       r" csw \d+/\d+ flt \d+/\d+\s+sleep",
+       "usage of running process not listed")
+expect(r"total\s+user \d+\.\d{3}s sys \d+\.\d{3}s maxrss \d+K",
+       "total not listed")
+expect_prompt()
+
+sendline("exit")
+expect_exact("exit\r\n", "Shell output extraneous characters")
+
+test_success()
@@ -0,0 +1,195 @@
+/*
+ * Input lines, pipeline templates and tagged output for the parallel
+ * builtin.
+ */
+#define _GNU_SOURCE    1
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "parallel.h"
+#include "utils.h"
+
+char **
+parallel_read_lines(FILE *f, size_t *n)
+{
+    char **lines = NULL;
+    size_t capacity = 0;
+    char *line = NULL;
+    size_t linecap = 0;
+    ssize_t len;
+
+    *n = 0;
+    while ((len = getline(&line, &linecap, f)) != -1) {
+        if (len > 0 && line[len - 1] == '\n')
+            line[len - 1] = '\0';
+        if (*n == capacity) {
+            capacity = capacity ? 2 * capacity : 64;
+            lines = realloc(lines, capacity * sizeof *lines);
+            if (lines == NULL)
+                utils_fatal_error("cannot allocate input lines: ");
+        }
+        lines[(*n)++] = line;
+        line = NULL;
+        linecap = 0;
+    }
+    free(line);
+    return lines;
+}
+
+/* Return 'word' with every "{}" replaced by 'arg', and set '*found'
+ * if there was one */
+static char *
+substitute(const char *word, const char *arg, bool *found)
+{
+    size_t arglen = strlen(arg), len = 0;
+    char *result = malloc(strlen(word) + 1);
+    if (result == NULL)
+        utils_fatal_error("cannot allocate command: ");
+
+    for (const char *p = word; *p; ) {
+        if (p[0] == '{' && p[1] == '}') {
+            result = realloc(result, len + arglen + strlen(p + 2) + 1);
+            if (result == NULL)
+                utils_fatal_error("cannot allocate command: ");
+            memcpy(result + len, arg, arglen);
+            len += arglen;
+            p += 2;
+            *found = true;
+        } else
+            result[len++] = *p++;
+    }
+    result[len] = '\0';
+    return result;
+}
+
+static char *
+xstrdup(const char *s)
+{
+    char *copy = s ? strdup(s) : NULL;
+    if (s != NULL && copy == NULL)
+        utils_fatal_error("cannot allocate command: ");
+    return copy;
+}
+
+struct ast_pipeline *
+parallel_instance(struct ast_pipeline *tmpl, const char *arg)
+{
+    struct ast_pipeline *pipe = ast_pipeline_create(
+            xstrdup("/dev/null"), xstrdup(tmpl->iored_output),
+            tmpl->append_to_output);
+    pipe->bg_job = true;
+
+    bool found = false;
+    for (struct list_elem *e = list_begin(&tmpl->commands);
+         e != list_end(&tmpl->commands); e = list_next(e)) {
+        struct ast_command *cmd = list_entry(e, struct ast_command, elem);
+        int argc = 0;
+        while (cmd->argv[argc])
+            argc++;
+
+        //Room for the argument appended if there is no {}
+        char **argv = malloc((argc + 2) * sizeof *argv);
+        if (argv == NULL)
+            utils_fatal_error("cannot allocate command: ");
+        for (int i = 0; i < argc; i++)
+            argv[i] = substitute(cmd->argv[i], arg, &found);
+        argv[argc] = NULL;
+        ast_pipeline_add_command(pipe,
+                ast_command_create(argv, cmd->dup_stderr_to_stdout));
+    }
+
+    if (!found) {
+        struct ast_command *first = list_entry(list_front(&pipe->commands),
+                                               struct ast_command, elem);
+        int argc = 0;
+        while (first->argv[argc])
+            argc++;
+        first->argv[argc] = xstrdup(arg);
+        first->argv[argc + 1] = NULL;
+    }
+    return pipe;
+}
+
+/* Print the complete lines in 'out->buf', or everything if 'all' */
+static void
+print_lines(struct tagged_output *out, bool all)
+{
+    size_t start = 0;
+    for (size_t i = 0; i < out->len; i++)
+        if (out->buf[i] == '\n') {
+            printf("%s\t%.*s\n", out->tag, (int) (i - start), out->buf + start);
+            start = i + 1;
+        }
+    if (all && start < out->len) {
+        printf("%s\t%.*s\n", out->tag, (int) (out->len - start),
+               out->buf + start);
+        start = out->len;
+    }
+    memmove(out->buf, out->buf + start, out->len - start);
+    out->len -= start;
+    fflush(stdout);
+}
+
+static void
+tagged_output_ready(struct event_source *src, uint32_t events)
+{
+    struct tagged_output *out = event_source_entry(src, struct tagged_output, ev);
+
+    if (out->capacity - out->len < 4096) {
+        out->capacity = 2 * out->capacity + 4096;
+        out->buf = realloc(out->buf, out->capacity);
+        if (out->buf == NULL)
+            utils_fatal_error("cannot allocate output buffer: ");
+    }
+    ssize_t n = read(src->fd, out->buf + out->len, out->capacity - out->len);
+    if (n > 0) {
+        out->len += n;
+        print_lines(out, false);
+    } else if (n == 0 || errno != EINTR) {
+        //End of output: the pipe is done with
+        event_loop_remove(src);
+        close(src->fd);
+        src->fd = -1;
+        print_lines(out, true);
+    }
+}
+
+struct tagged_output *
+tagged_output_open(const char *tag, int *write_fd)
+{
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) == -1)
+        return NULL;
+
+    struct tagged_output *out = calloc(1, sizeof *out);
+    if (out == NULL)
+        utils_fatal_error("cannot allocate output buffer: ");
+    out->tag = xstrdup(tag);
+    out->ev.fd = fds[0];
+    out->ev.handler = tagged_output_ready;
+    event_loop_add(&out->ev, EPOLLIN);
+    *write_fd = fds[1];
+    return out;
+}
+
+bool
+tagged_output_done(struct tagged_output *out)
+{
+    return out->ev.fd == -1;
+}
+
+void
+tagged_output_close(struct tagged_output *out)
+{
+    if (out->ev.fd != -1) {
+        event_loop_remove(&out->ev);
+        close(out->ev.fd);
+    }
+    print_lines(out, true);
+    free(out->buf);
+    free(out->tag);
+    free(out);
+}
@@ -0,0 +1,50 @@
+#ifndef __PARALLEL_H
+#define __PARALLEL_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "shell-ast.h"
+#include "event_loop.h"
+
+/*
+ * Helpers for the parallel builtin, which runs a pipeline once per
+ * line of input, with '{}' in its words replaced by the line, as up
+ * to N concurrent jobs.  The shell runs and reaps these jobs; this
+ * module prepares their pipelines and prefixes their output.
+ */
+
+/* Read the lines of 'f', without their newlines.  Returns the array
+ * of lines and their number in '*n'; both are freed by the caller. */
+char ** parallel_read_lines(FILE *f, size_t *n);
+
+/* Return a copy of 'tmpl' for input line 'arg': every "{}" in a word
+ * is replaced by 'arg', or, if no word contains one, 'arg' is added
+ * as the last argument of the first command.  The copy reads from
+ * /dev/null and runs in the background. */
+struct ast_pipeline * parallel_instance(struct ast_pipeline *tmpl,
+                                        const char *arg);
+
+/* The output of one job, printed line by line with a tag in front.
+ * The shell reads the pipe through the event loop. */
+struct tagged_output {
+    struct event_source ev;     /* Read end of the job's stdout pipe */
+    char *tag;
+    char *buf;                  /* Partial line not yet printed */
+    size_t len, capacity;
+};
+
+/* Start tagging the output written to the returned descriptor, the
+ * write end of a close-on-exec pipe, with 'tag'.  Returns NULL, with
+ * errno set, if the pipe cannot be created. */
+struct tagged_output * tagged_output_open(const char *tag, int *write_fd);
+
+/* Return true once the writers have closed the pipe and everything
+ * has been printed */
+bool tagged_output_done(struct tagged_output *out);
+
+/* Stop monitoring the pipe, print what is left and free 'out' */
+void tagged_output_close(struct tagged_output *out);
+
+#endif /* __PARALLEL_H */
@@ -0,0 +1,78 @@
+#!/usr/bin/python
+#
+# Tests the parallel builtin: one job per input line with {} replaced,
+# bounded concurrency, --tag, the failure count and ^C.
+#
+import atexit, proc_check, time, os, re
+from testutils import *
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+argfile = "parallel-test-args.txt"
+open(argfile, "w").write("one\ntwo\nthree\nfour\n")
+atexit.register(lambda: os.path.exists(argfile) and os.remove(argfile))
+
+sendline("parallel -j 2 echo item {} done < " + argfile)
+seen = set()
+for i in range(4):
+    (item,) = parse_regular_expression(console, r"item (\w+) done")
+    seen.add(item)
+assert seen == set(["one", "two", "three", "four"]), "not every line ran"
+expect_prompt()
+
+# lines without {} are appended, and output is tagged line by line
+sendline("parallel --tag -a " + argfile + " echo hello")
+seen = set()
+for i in range(4):
+    (item,) = parse_regular_expression(console, r"(\w+)\thello \w+")
+    seen.add(item)
+assert seen == set(["one", "two", "three", "four"]), "output not tagged"
+expect_prompt()
+
+# four one-second sleeps take about a second with -j 4
+open(argfile, "w").write("1\n1\n1\n1\n")
+start = time.time()
+sendline("parallel -j 4 sleep < " + argfile)
+expect_prompt()
+assert time.time() - start < 3, "jobs did not run concurrently"
+
+sendline("parallel ls /nonexistent-{} < " + argfile)
+expect_exact("parallel: 4 of 4 jobs failed", "failures not counted")
+expect_prompt()
+
+# a job started with 'after' does not wait for parallel to return
+sendline("sleep 1 &")
+(jobid, pid) = parse_bg_status()
+expect_prompt()
+sendline("after %%%s -- echo dependent ran" % jobid)
+expect_prompt()
+start = time.time()
+sendline("parallel -j 1 sleep < " + argfile)
+assert console.expect_exact("dependent ran", timeout=10) == 0, \
+    "dependent job did not run"
+assert time.time() - start < 3, "dependent job waited for parallel"
+# the rest of the four one-second sleeps
+time.sleep(3.5)
+expect_prompt()
+
+# ^C interrupts the running jobs and starts no more
+open(argfile, "w").write("30\n30\n30\n30\n")
+sendline("parallel -j 2 sleep < " + argfile)
+proc_check.count_children_timeout(console, 2, 1)
+sendintr()
+expect_exact("parallel: 2 of 2 jobs failed", "jobs were not interrupted")
+expect_exact("parallel: 2 jobs not started", "more jobs were started")
+expect_prompt()
+
+# the shell has no jobs left over
+sendline("jobs")
+expect_prompt()
+assert not re.search(r"\[\d+\]", console.before), "parallel left jobs behind"
+
+sendline("exit")
+expect_exact("exit\r\n", "Shell output extraneous characters")
+
+test_success()
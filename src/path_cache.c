@@ -0,0 +1,239 @@
+/*
+ * A hash table from command names to their resolved executables.
+ *
+ * Open addressing with linear probing, keyed by FNV-1a of the name.
+ * Entries are never removed individually, only all at once, so no
+ * deletion logic is needed.  The table doubles once it is half full.
+ *
+ * The PATH that entries were resolved against is kept split into its
+ * directories, along with the modification time each had then.
+ * Adding or removing a file in a directory changes its mtime, so
+ * comparing them is enough to tell that a cached result, positive
+ * or negative, may have become wrong.  If PATH contains relative
+ * directories, results depend on the current directory and are not
+ * cached at all.
+ */
+#define _GNU_SOURCE    1
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "path_cache.h"
+#include "utils.h"
+
+struct path_entry {
+    char *name;              /* NULL if slot is empty */
+    char *path;              /* NULL if not found in PATH */
+    unsigned hits;           /* Number of lookups that used the entry */
+};
+
+#define PATH_CACHE_MIN_SIZE 64
+
+/* Search path used if PATH is not set, as execvp() does */
+#define DEFAULT_PATH "/bin:/usr/bin"
+
+static struct path_entry *entries;
+static size_t capacity;      /* always a power of 2 */
+static size_t used;
+
+static char *cached_path;    /* PATH the entries were resolved against */
+static char **dirs;          /* its directories, "" for the current one */
+static struct timespec *dir_mtimes;  /* tv_nsec -1 if it did not exist */
+static size_t ndirs;
+static bool cacheable;       /* false if PATH has relative directories */
+
+static char *uncached;       /* last result returned without caching */
+static unsigned generation;  /* incremented when entries are discarded,
+                                and with each uncached result */
+
+static inline size_t
+path_hash(const char *name)
+{
+    uint32_t h = 2166136261u;
+    while (*name)
+        h = (h ^ (unsigned char) *name++) * 16777619u;
+    return h & (capacity - 1);
+}
+
+/* Return the slot holding 'name', or the empty slot ending its probe run */
+static struct path_entry *
+path_cache_find(const char *name)
+{
+    size_t i = path_hash(name);
+    while (entries[i].name != NULL && strcmp(entries[i].name, name) != 0)
+        i = (i + 1) & (capacity - 1);
+    return &entries[i];
+}
+
+static void
+path_cache_resize(size_t newcapacity)
+{
+    struct path_entry *old = entries;
+    size_t oldcapacity = capacity;
+
+    entries = calloc(newcapacity, sizeof *entries);
+    if (entries == NULL)
+        utils_fatal_error("cannot grow path cache: ");
+    capacity = newcapacity;
+
+    for (size_t i = 0; i < oldcapacity; i++)
+        if (old[i].name != NULL)
+            *path_cache_find(old[i].name) = old[i];
+    free(old);
+}
+
+/* Search the directories of PATH for an executable regular file
+ * called 'name'.  Returns a malloc'd path, or NULL if none was found. */
+static char *
+path_search(const char *name)
+{
+    char buf[PATH_MAX];
+    struct stat st;
+
+    for (size_t i = 0; i < ndirs; i++) {
+        const char *dir = *dirs[i] ? dirs[i] : ".";
+        if (snprintf(buf, sizeof buf, "%s/%s", dir, name) >= sizeof buf)
+            continue;
+        if (stat(buf, &st) == 0 && S_ISREG(st.st_mode)
+            && access(buf, X_OK) == 0)
+            return strdup(buf);
+    }
+    return NULL;
+}
+
+/* Return the modification time of 'dir', tv_nsec -1 if it does not exist */
+static struct timespec
+dir_mtime(const char *dir)
+{
+    struct stat st;
+    if (stat(*dir ? dir : ".", &st) == -1)
+        return (struct timespec) { .tv_nsec = -1 };
+    return st.st_mtim;
+}
+
+/* Split 'path' into dirs[] and record their modification times */
+static void
+path_snapshot(const char *path)
+{
+    free(cached_path);
+    free(dirs);
+    free(dir_mtimes);
+
+    cached_path = strdup(path);
+    ndirs = 1;
+    for (const char *p = path; *p; p++)
+        ndirs += *p == ':';
+
+    /* dirs[] points into a copy of 'path' whose ':' are replaced by NUL */
+    dirs = malloc(ndirs * sizeof *dirs + strlen(path) + 1);
+    dir_mtimes = malloc(ndirs * sizeof *dir_mtimes);
+    if (cached_path == NULL || dirs == NULL || dir_mtimes == NULL)
+        utils_fatal_error("cannot allocate path cache: ");
+
+    char *copy = strcpy((char *) (dirs + ndirs), path);
+    cacheable = true;
+    for (size_t i = 0; i < ndirs; i++) {
+        dirs[i] = copy;
+        copy = strchrnul(copy, ':');
+        if (*copy)
+            *copy++ = '\0';
+        if (dirs[i][0] != '/')
+            cacheable = false;
+        dir_mtimes[i] = dir_mtime(dirs[i]);
+    }
+}
+
+void
+path_cache_revalidate(void)
+{
+    const char *path = getenv("PATH");
+    if (path == NULL)
+        path = DEFAULT_PATH;
+
+    bool valid = cached_path != NULL && strcmp(path, cached_path) == 0;
+    for (size_t i = 0; valid && i < ndirs; i++) {
+        struct timespec now = dir_mtime(dirs[i]);
+        valid = now.tv_sec == dir_mtimes[i].tv_sec
+             && now.tv_nsec == dir_mtimes[i].tv_nsec;
+    }
+
+    if (!valid) {
+        path_cache_clear();
+        path_snapshot(path);
+    }
+}
+
+const char *
+path_cache_lookup(const char *name)
+{
+    if (strchr(name, '/'))
+        return name;
+
+    if (cached_path == NULL)
+        path_cache_revalidate();
+
+    /* Uncached results depend on the current directory, so a copy of
+     * one may be wrong by the time it is used again. */
+    if (!cacheable) {
+        free(uncached);
+        uncached = path_search(name);
+        generation++;
+        return uncached;
+    }
+
+    if (2 * (used + 1) > capacity)
+        path_cache_resize(capacity ? 2 * capacity : PATH_CACHE_MIN_SIZE);
+
+    struct path_entry *e = path_cache_find(name);
+    if (e->name == NULL) {
+        e->name = strdup(name);
+        e->path = path_search(name);
+        used++;
+    }
+    e->hits++;
+    return e->path;
+}
+
+void
+path_cache_clear(void)
+{
+    for (size_t i = 0; i < capacity; i++) {
+        free(entries[i].name);
+        free(entries[i].path);
+    }
+    if (capacity > 0)
+        memset(entries, 0, capacity * sizeof *entries);
+    used = 0;
+    generation++;
+}
+
+unsigned
+path_cache_generation(void)
+{
+    return generation;
+}
+
+void
+path_cache_print(void)
+{
+    if (used == 0) {
+        printf("hash: hash table empty\n");
+        return;
+    }
+
+    printf("hits\tcommand\n");
+    for (size_t i = 0; i < capacity; i++) {
+        struct path_entry *e = &entries[i];
+        if (e->name == NULL)
+            continue;
+        if (e->path)
+            printf("%4u\t%s\n", e->hits, e->path);
+        else
+            printf("%4u\t%s (not found)\n", e->hits, e->name);
+    }
+}
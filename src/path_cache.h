@@ -0,0 +1,39 @@
+#ifndef __PATH_CACHE_H
+#define __PATH_CACHE_H
+
+/*
+ * A cache mapping command names to the executable that a PATH search
+ * finds for them, including the fact that none was found.
+ *
+ * Without it, every stage of every pipeline is spawned with
+ * posix_spawnp(), which tries execve() in each PATH directory in
+ * turn until one succeeds.  With it, the search is done once per
+ * command name and the stage is spawned directly.
+ *
+ * Entries remain valid as long as PATH is unchanged and none of
+ * its directories has been modified, which is checked by
+ * path_cache_revalidate().
+ */
+
+/* Return the absolute path of the executable 'name' runs, or NULL if
+ * there is none.  Names containing a slash are returned unchanged.
+ * The result is valid until the next call into this module. */
+const char * path_cache_lookup(const char *name);
+
+/* Discard all entries if PATH or the modification time of any of
+ * its directories has changed since they were looked up.  Called
+ * once per command line, before its commands are spawned. */
+void path_cache_revalidate(void);
+
+/* Discard all entries */
+void path_cache_clear(void);
+
+/* Return a number that changes whenever a result path_cache_lookup()
+ * returned earlier may have become wrong.  Callers that keep a copy
+ * of a result must look it up again when it differs. */
+unsigned path_cache_generation(void);
+
+/* Print the cached entries along with their number of hits */
+void path_cache_print(void);
+
+#endif /* __PATH_CACHE_H */
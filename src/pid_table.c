@@ -0,0 +1,138 @@
+/*
+ * Pid-keyed hash tables.
+ *
+ * Open addressing with linear probing.  Deletion shifts later
+ * entries of the same probe run back, so there are no tombstones
+ * and lookups stay short no matter how many children have come
+ * and gone.  The table doubles once it is half full.
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "pid_table.h"
+#include "utils.h"
+
+struct pid_slot {
+    pid_t pid;               /* 0 if slot is empty */
+    void *value;
+};
+
+#define PID_TABLE_MIN_SIZE 64
+
+/* Fibonacci hashing spreads consecutive pids across the table.  The
+ * high bits of the product are the well-mixed ones, so the index is
+ * taken from them. */
+static inline size_t
+pid_hash(struct pid_table *t, pid_t pid)
+{
+    return (size_t) (((uint32_t) pid * 2654435769u) >> (32 - t->capacity_bits));
+}
+
+static void
+pid_table_resize(struct pid_table *t, size_t newcapacity)
+{
+    struct pid_slot *old = t->slots;
+    size_t oldcapacity = t->capacity;
+
+    t->slots = calloc(newcapacity, sizeof *t->slots);
+    if (t->slots == NULL)
+        utils_fatal_error("cannot grow pid table: ");
+    t->capacity = newcapacity;
+    for (t->capacity_bits = 0; ((size_t) 1 << t->capacity_bits) < t->capacity; )
+        t->capacity_bits++;
+
+    for (size_t i = 0; i < oldcapacity; i++) {
+        if (old[i].pid == 0)
+            continue;
+
+        size_t j = pid_hash(t, old[i].pid);
+        while (t->slots[j].pid != 0)
+            j = (j + 1) & (t->capacity - 1);
+        t->slots[j] = old[i];
+    }
+    free(old);
+}
+
+/* Return the slot holding 'pid', or the empty slot ending its probe run */
+static struct pid_slot *
+pid_table_find(struct pid_table *t, pid_t pid)
+{
+    size_t i = pid_hash(t, pid);
+    while (t->slots[i].pid != 0 && t->slots[i].pid != pid)
+        i = (i + 1) & (t->capacity - 1);
+    return &t->slots[i];
+}
+
+void
+pid_table_insert(struct pid_table *t, pid_t pid, void *value)
+{
+    assert(pid > 0);
+    if (2 * (t->used + 1) > t->capacity)
+        pid_table_resize(t, t->capacity ? 2 * t->capacity : PID_TABLE_MIN_SIZE);
+
+    struct pid_slot *s = pid_table_find(t, pid);
+    assert(s->pid == 0 || !!!"pid inserted twice");
+    s->pid = pid;
+    s->value = value;
+    t->used++;
+}
+
+void *
+pid_table_lookup(struct pid_table *t, pid_t pid)
+{
+    if (t->used == 0 || pid <= 0)
+        return NULL;
+
+    return pid_table_find(t, pid)->value;
+}
+
+bool
+pid_table_remove(struct pid_table *t, pid_t pid)
+{
+    if (t->used == 0 || pid <= 0)
+        return false;
+
+    struct pid_slot *s = pid_table_find(t, pid);
+    if (s->pid == 0)
+        return false;
+
+    /* Shift back later members of this probe run that would no longer
+     * be reachable once the slot is emptied. */
+    struct pid_slot *slots = t->slots;
+    size_t mask = t->capacity - 1;
+    size_t hole = s - slots;
+    size_t i = hole;
+    for (;;) {
+        i = (i + 1) & mask;
+        if (slots[i].pid == 0)
+            break;
+
+        size_t home = pid_hash(t, slots[i].pid);
+        /* Move entry i into the hole unless its home lies cyclically
+         * within (hole, i]. */
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            slots[hole] = slots[i];
+            hole = i;
+        }
+    }
+    slots[hole].pid = 0;
+    slots[hole].value = NULL;
+    t->used--;
+    return true;
+}
+
+void
+pid_table_foreach(struct pid_table *t,
+                  void (*fn)(pid_t pid, void *value, void *arg), void *arg)
+{
+    for (size_t i = 0; i < t->capacity; i++)
+        if (t->slots[i].pid != 0)
+            fn(t->slots[i].pid, t->slots[i].value, arg);
+}
+
+size_t
+pid_table_size(struct pid_table *t)
+{
+    return t->used;
+}
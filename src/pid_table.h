@@ -0,0 +1,44 @@
+#ifndef __PID_TABLE_H
+#define __PID_TABLE_H
+
+#include <sys/types.h>
+#include <stdbool.h>
+
+/*
+ * A hash table mapping process ids to an opaque value.
+ *
+ * The shell uses one to find the job (and the pipeline stage within
+ * that job) a reaped child belongs to in O(1), independent of how
+ * many jobs exist, and another to find a job by its process group.
+ *
+ * A zero-initialized struct pid_table is an empty table.
+ */
+
+struct pid_slot;
+
+struct pid_table {
+    struct pid_slot *slots;
+    size_t capacity;         /* always a power of 2, or 0 */
+    int capacity_bits;       /* log2(capacity) */
+    size_t used;
+};
+
+/* Record that 'pid' maps to 'value'.  'pid' must not be present yet. */
+void pid_table_insert(struct pid_table *t, pid_t pid, void *value);
+
+/* Return the value recorded for 'pid', or NULL if there is none */
+void * pid_table_lookup(struct pid_table *t, pid_t pid);
+
+/* Remove 'pid' from the table.  Returns true if it was present. */
+bool pid_table_remove(struct pid_table *t, pid_t pid);
+
+/* Call 'fn' with each pid in the table, its value and 'arg'.  'fn'
+ * must not insert or remove pids. */
+void pid_table_foreach(struct pid_table *t,
+                       void (*fn)(pid_t pid, void *value, void *arg),
+                       void *arg);
+
+/* Return the number of pids currently in the table */
+size_t pid_table_size(struct pid_table *t);
+
+#endif /* __PID_TABLE_H */
@@ -0,0 +1,219 @@
+/*
+ * Cache domains and the placement policies built on them.
+ *
+ * The topology is read once, when a policy other than 'off' is first
+ * used.  For each CPU the shell may run on, the cache with the highest
+ * level listed under cpuN/cache/ is taken to be its last level cache,
+ * and the CPUs sharing it form its domain.  If the kernel does not
+ * export cache information, all CPUs form a single domain.
+ */
+#define _GNU_SOURCE    1
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "placement.h"
+#include "utils.h"
+
+#define SYSFS_CPU "/sys/devices/system/cpu"
+
+struct cache_domain {
+    cpu_set_t cpus;
+    int ncpus;
+    int *cpu;               /* The CPUs of 'cpus' in ascending order */
+};
+
+static struct cache_domain *domains;
+static int ndomains;
+
+static enum placement_policy policy = PLACEMENT_OFF;
+static struct cache_domain *job_domain;
+static unsigned next_domain;    /* Domain the next job gets */
+static int domain_used;         /* CPUs of it taken by compact jobs */
+static int job_stages;          /* Stages placed for the current job */
+
+static const char *policy_names[] = {
+    [PLACEMENT_OFF] = "off",
+    [PLACEMENT_COMPACT] = "compact",
+    [PLACEMENT_SPREAD] = "spread",
+};
+
+/* Parse a list such as "0-3,8,10-11" into 'set' */
+static bool
+parse_cpu_list(const char *s, cpu_set_t *set)
+{
+    CPU_ZERO(set);
+    while (isdigit((unsigned char) *s)) {
+        char *end;
+        long first = strtol(s, &end, 10), last = first;
+        if (*end == '-')
+            last = strtol(end + 1, &end, 10);
+        if (first < 0 || last >= CPU_SETSIZE || first > last)
+            return false;
+        for (long cpu = first; cpu <= last; cpu++)
+            CPU_SET(cpu, set);
+        s = *end == ',' ? end + 1 : end;
+    }
+    return CPU_COUNT(set) > 0;
+}
+
+/* Read the first line of sysfs file 'path' into 'buf' */
+static bool
+read_line(const char *path, char *buf, size_t size)
+{
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+        return false;
+    bool ok = fgets(buf, size, f) != NULL;
+    fclose(f);
+    return ok;
+}
+
+/* Find the CPUs that share the last level cache of 'cpu' */
+static bool
+llc_shared_cpus(int cpu, cpu_set_t *shared)
+{
+    char path[128], line[4096];
+    int best_level = 0;
+
+    for (int index = 0; ; index++) {
+        snprintf(path, sizeof path, SYSFS_CPU "/cpu%d/cache/index%d/level",
+                 cpu, index);
+        if (!read_line(path, line, sizeof line))
+            break;
+        int level = atoi(line);
+
+        snprintf(path, sizeof path, SYSFS_CPU "/cpu%d/cache/index%d/type",
+                 cpu, index);
+        if (read_line(path, line, sizeof line)
+            && strncmp(line, "Instruction", 11) == 0)
+            continue;
+
+        snprintf(path, sizeof path,
+                 SYSFS_CPU "/cpu%d/cache/index%d/shared_cpu_list", cpu, index);
+        if (level > best_level && read_line(path, line, sizeof line)
+            && parse_cpu_list(line, shared))
+            best_level = level;
+    }
+    return best_level > 0;
+}
+
+static void
+read_topology(void)
+{
+    cpu_set_t allowed, assigned;
+    if (sched_getaffinity(0, sizeof allowed, &allowed) == -1)
+        utils_fatal_error("sched_getaffinity: ");
+    CPU_ZERO(&assigned);
+
+    domains = calloc(CPU_COUNT(&allowed), sizeof *domains);
+    if (domains == NULL)
+        utils_fatal_error("cannot allocate cache domains: ");
+
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &allowed) || CPU_ISSET(cpu, &assigned))
+            continue;
+
+        struct cache_domain *d = &domains[ndomains++];
+        if (!llc_shared_cpus(cpu, &d->cpus))
+            d->cpus = allowed;
+        CPU_AND(&d->cpus, &d->cpus, &allowed);
+        CPU_SET(cpu, &d->cpus);
+        CPU_OR(&assigned, &assigned, &d->cpus);
+
+        d->cpu = malloc(CPU_COUNT(&d->cpus) * sizeof *d->cpu);
+        if (d->cpu == NULL)
+            utils_fatal_error("cannot allocate cache domains: ");
+        for (int c = 0; c < CPU_SETSIZE; c++)
+            if (CPU_ISSET(c, &d->cpus))
+                d->cpu[d->ncpus++] = c;
+    }
+}
+
+void
+placement_set_policy(enum placement_policy newpolicy)
+{
+    if (newpolicy != PLACEMENT_OFF && domains == NULL)
+        read_topology();
+    policy = newpolicy;
+}
+
+bool
+placement_policy_parse(const char *name, enum placement_policy *result)
+{
+    for (int i = 0; i < sizeof policy_names / sizeof policy_names[0]; i++)
+        if (strcmp(name, policy_names[i]) == 0) {
+            *result = i;
+            return true;
+        }
+    return false;
+}
+
+void
+placement_begin_job(void)
+{
+    /* Compact jobs fill a domain, one CPU per stage of each job
+     * placed so far, before the next domain is used */
+    if (job_domain != NULL && policy == PLACEMENT_COMPACT) {
+        domain_used += job_stages;
+        if (domain_used >= job_domain->ncpus) {
+            next_domain++;
+            domain_used = 0;
+        }
+    }
+    job_stages = 0;
+
+    switch (policy) {
+    case PLACEMENT_OFF:
+        job_domain = NULL;
+        break;
+    case PLACEMENT_COMPACT:
+        job_domain = &domains[next_domain % ndomains];
+        break;
+    case PLACEMENT_SPREAD:
+        job_domain = &domains[next_domain++ % ndomains];
+        break;
+    }
+}
+
+const cpu_set_t *
+placement_stage_cpus(int i)
+{
+    if (job_domain == NULL)
+        return NULL;
+
+    /* Each stage may use the whole domain: adjacent stages share
+     * its cache, and the scheduler still balances them within it */
+    if (i >= job_stages)
+        job_stages = i + 1;
+    return &job_domain->cpus;
+}
+
+/* Print the CPUs of 'd' as a list of ranges */
+static void
+print_cpu_list(const struct cache_domain *d)
+{
+    for (int i = 0; i < d->ncpus; ) {
+        int j = i;
+        while (j + 1 < d->ncpus && d->cpu[j + 1] == d->cpu[j] + 1)
+            j++;
+        printf(i ? ",%d" : "%d", d->cpu[i]);
+        if (j > i)
+            printf("-%d", d->cpu[j]);
+        i = j + 1;
+    }
+}
+
+void
+placement_print(void)
+{
+    printf("placement: %s\n", policy_names[policy]);
+    if (domains == NULL)
+        read_topology();
+    for (int i = 0; i < ndomains; i++) {
+        printf("cache domain %d: cpus ", i);
+        print_cpu_list(&domains[i]);
+        printf("\n");
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef __PLACEMENT_H
+#define __PLACEMENT_H
+
+#include <stdbool.h>
+#include <sched.h>
+
+/*
+ * Placement of pipeline stages on CPUs, following the cache topology
+ * the kernel exports in /sys/devices/system/cpu.
+ *
+ * Adjacent stages of a pipeline pass all their data through a pipe
+ * buffer, which stays in the last level cache if both run on CPUs
+ * that share it.  The CPUs the shell may use are grouped into cache
+ * domains, one per last level cache, and each job is kept within one
+ * of them.
+ */
+enum placement_policy {
+    PLACEMENT_OFF,          /* Stages run wherever the scheduler puts them */
+    PLACEMENT_COMPACT,      /* Each job may use all CPUs of one domain,
+                               and jobs fill a domain, one CPU per
+                               stage, before moving to the next */
+    PLACEMENT_SPREAD,       /* Each job may use all CPUs of one domain,
+                               and successive jobs rotate among them */
+};
+
+/* Set the policy applied to jobs spawned from now on */
+void placement_set_policy(enum placement_policy policy);
+
+/* Return the policy named 'name' in '*policy', or false if there is none */
+bool placement_policy_parse(const char *name, enum placement_policy *policy);
+
+/* Choose the domain for a new job.  Called before its first stage
+ * is spawned. */
+void placement_begin_job(void);
+
+/* Return the CPUs stage 'i' (counting from 0) of the job may run on,
+ * or NULL if it is not restricted. */
+const cpu_set_t * placement_stage_cpus(int i);
+
+/* Print the policy and the cache domains */
+void placement_print(void);
+
+#endif /* __PLACEMENT_H */
@@ -0,0 +1,39 @@
+#!/usr/bin/python
+#
+# Tests the placement builtin: it lists the cache domains, and under the
+# compact policy each stage may use all CPUs of one domain.
+#
+import atexit, proc_check, re, time
+from testutils import *
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+sendline("placement")
+expect_exact("placement: off", "placement did not print the policy")
+expect_prompt()
+domains = re.findall(r"cache domain \d+: cpus (\S+)", console.before)
+assert domains, "placement did not print the domains"
+
+sendline("placement nearby")
+expect_exact("usage", "placement accepted an unknown policy")
+expect_prompt()
+
+sendline("placement compact")
+expect_prompt()
+sendline("sleep 30 &")
+(jobid, pid) = parse_bg_status()
+expect_prompt()
+allowed = [l.split()[1] for l in open("/proc/%s/status" % pid)
+           if l.startswith("Cpus_allowed_list:")][0]
+assert allowed in domains, "stage is not kept to one domain: " + allowed
+
+run_builtin("kill", jobid)
+expect_prompt()
+
+sendline("exit")
+expect_exact("exit\r\n", "Shell output extraneous characters")
+
+test_success()
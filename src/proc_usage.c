@@ -0,0 +1,103 @@
+/*
+ * Resource usage accounting helpers.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "proc_usage.h"
+
+/* Convert clock ticks as found in /proc/<pid>/stat into a timeval */
+static struct timeval
+ticks_to_timeval(unsigned long long ticks)
+{
+    static long hz;
+    if (hz == 0)
+        hz = sysconf(_SC_CLK_TCK);
+
+    struct timeval tv = {
+        .tv_sec = ticks / hz,
+        .tv_usec = (ticks % hz) * 1000000 / hz
+    };
+    return tv;
+}
+
+bool
+proc_usage_read(pid_t pid, struct rusage *ru)
+{
+    char path[64], buf[1024];
+
+    memset(ru, 0, sizeof *ru);
+
+    snprintf(path, sizeof path, "/proc/%d/stat", pid);
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+        return false;
+
+    size_t n = fread(buf, 1, sizeof buf - 1, f);
+    fclose(f);
+    buf[n] = '\0';
+
+    /* The command name (field 2) may contain spaces and parentheses,
+     * so start parsing after the last ')'. */
+    char *p = strrchr(buf, ')');
+    unsigned long minflt, majflt;
+    unsigned long long utime, stime;
+    if (p == NULL
+        || sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %lu %*u %lu %*u %llu %llu",
+                  &minflt, &majflt, &utime, &stime) != 4)
+        return false;
+
+    ru->ru_minflt = minflt;
+    ru->ru_majflt = majflt;
+    ru->ru_utime = ticks_to_timeval(utime);
+    ru->ru_stime = ticks_to_timeval(stime);
+
+    /* Peak RSS and context switches are only found in 'status' */
+    snprintf(path, sizeof path, "/proc/%d/status", pid);
+    f = fopen(path, "r");
+    if (f == NULL)
+        return true;
+
+    while (fgets(buf, sizeof buf, f)) {
+        sscanf(buf, "VmHWM: %ld", &ru->ru_maxrss);
+        sscanf(buf, "voluntary_ctxt_switches: %ld", &ru->ru_nvcsw);
+        sscanf(buf, "nonvoluntary_ctxt_switches: %ld", &ru->ru_nivcsw);
+    }
+    fclose(f);
+    return true;
+}
+
+static void
+timeval_add(struct timeval *total, const struct timeval *tv)
+{
+    total->tv_sec += tv->tv_sec;
+    total->tv_usec += tv->tv_usec;
+    if (total->tv_usec >= 1000000) {
+        total->tv_sec++;
+        total->tv_usec -= 1000000;
+    }
+}
+
+void
+proc_usage_add(struct rusage *total, const struct rusage *ru)
+{
+    timeval_add(&total->ru_utime, &ru->ru_utime);
+    timeval_add(&total->ru_stime, &ru->ru_stime);
+    total->ru_maxrss += ru->ru_maxrss;
+    total->ru_minflt += ru->ru_minflt;
+    total->ru_majflt += ru->ru_majflt;
+    total->ru_nvcsw += ru->ru_nvcsw;
+    total->ru_nivcsw += ru->ru_nivcsw;
+}
+
+void
+proc_usage_print(const struct rusage *ru)
+{
+    printf("user %ld.%03lds sys %ld.%03lds maxrss %ldK "
+           "csw %ld/%ld flt %ld/%ld",
+           (long) ru->ru_utime.tv_sec, (long) ru->ru_utime.tv_usec / 1000,
+           (long) ru->ru_stime.tv_sec, (long) ru->ru_stime.tv_usec / 1000,
+           ru->ru_maxrss, ru->ru_nvcsw, ru->ru_nivcsw,
+           ru->ru_minflt, ru->ru_majflt);
+}
@@ -0,0 +1,24 @@
+#ifndef __PROC_USAGE_H
+#define __PROC_USAGE_H
+
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <stdbool.h>
+
+/*
+ * Resource usage of processes, as reported by wait4() for processes
+ * that have been reaped, or sampled from /proc for live ones.
+ */
+
+/* Fill in user/system CPU time, peak RSS, context switches and page
+ * faults of the live process 'pid' from /proc.  Fields that cannot be
+ * determined are zero.  Returns false if the process does not exist. */
+bool proc_usage_read(pid_t pid, struct rusage *ru);
+
+/* Add the counters in 'ru' to 'total' */
+void proc_usage_add(struct rusage *total, const struct rusage *ru);
+
+/* Print 'ru' on one line (without a newline) */
+void proc_usage_print(const struct rusage *ru);
+
+#endif /* __PROC_USAGE_H */
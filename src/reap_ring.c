@@ -0,0 +1,76 @@
+/*
+ * Single-producer/single-consumer ring of reaped child statuses.
+ *
+ * 'head' is only written by the consumer and 'tail' only by the
+ * producer.  Each side publishes its index with a release store
+ * after touching the slots, and reads the other side's index with
+ * an acquire load, so no locks are needed.
+ */
+#include <stdatomic.h>
+#include <string.h>
+
+#include "reap_ring.h"
+
+_Static_assert((REAP_RING_SIZE & (REAP_RING_SIZE - 1)) == 0,
+               "REAP_RING_SIZE must be a power of 2");
+
+static struct reap_record ring[REAP_RING_SIZE];
+static atomic_size_t head;      /* next record to be consumed */
+static atomic_size_t tail;      /* next free slot */
+static atomic_bool overflow;
+
+bool
+reap_ring_full(void)
+{
+    size_t t = atomic_load_explicit(&tail, memory_order_relaxed);
+    size_t h = atomic_load_explicit(&head, memory_order_acquire);
+    return t - h == REAP_RING_SIZE;
+}
+
+void
+reap_ring_set_overflow(void)
+{
+    atomic_store_explicit(&overflow, true, memory_order_release);
+}
+
+bool
+reap_ring_push(pid_t pid, int status, const struct rusage *usage)
+{
+    if (reap_ring_full()) {
+        reap_ring_set_overflow();
+        return false;
+    }
+
+    size_t t = atomic_load_explicit(&tail, memory_order_relaxed);
+    struct reap_record *r = &ring[t & (REAP_RING_SIZE - 1)];
+    r->pid = pid;
+    r->status = status;
+    if (usage)
+        r->usage = *usage;
+    else
+        memset(&r->usage, 0, sizeof r->usage);
+    clock_gettime(CLOCK_MONOTONIC, &r->when);
+    atomic_store_explicit(&tail, t + 1, memory_order_release);
+    return true;
+}
+
+size_t
+reap_ring_pop(struct reap_record *out, size_t max)
+{
+    size_t h = atomic_load_explicit(&head, memory_order_relaxed);
+    size_t t = atomic_load_explicit(&tail, memory_order_acquire);
+    size_t n = 0;
+
+    while (h + n != t && n < max) {
+        out[n] = ring[(h + n) & (REAP_RING_SIZE - 1)];
+        n++;
+    }
+    atomic_store_explicit(&head, h + n, memory_order_release);
+    return n;
+}
+
+bool
+reap_ring_test_and_clear_overflow(void)
+{
+    return atomic_exchange_explicit(&overflow, false, memory_order_acq_rel);
+}
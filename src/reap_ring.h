@@ -0,0 +1,50 @@
+#ifndef __REAP_RING_H
+#define __REAP_RING_H
+
+#include <sys/types.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+#include <sys/resource.h>
+
+/*
+ * A preallocated single-producer/single-consumer ring of child
+ * status changes.
+ *
+ * The code that learns about a status change (reaping a pidfd that
+ * became readable, collecting a stop after SIGCHLD) only pushes a
+ * record here, which is lock-free and async-signal-safe.  The
+ * expensive work of updating jobs and printing is done when the
+ * shell drains the ring in batches.
+ */
+struct reap_record {
+    pid_t pid;                  /* Child whose status changed */
+    int status;                 /* waitpid()-style status */
+    struct timespec when;       /* CLOCK_MONOTONIC time it was collected */
+    struct rusage usage;        /* Resources used, if the child was reaped */
+};
+
+/* Number of records the ring can hold */
+#define REAP_RING_SIZE 256
+
+/* Return true if there is no room for another record.  A producer
+ * that finds the ring full must leave the status uncollected and
+ * call reap_ring_set_overflow(). */
+bool reap_ring_full(void);
+
+/* Append a record, timestamping it.  'usage' is NULL for status
+ * changes other than termination.  Returns false (and flags an
+ * overflow) if the ring was full. */
+bool reap_ring_push(pid_t pid, int status, const struct rusage *usage);
+
+/* Record that status changes were left uncollected */
+void reap_ring_set_overflow(void);
+
+/* Remove up to 'max' records into 'out'.  Returns the number removed. */
+size_t reap_ring_pop(struct reap_record *out, size_t max);
+
+/* Return true, and clear the flag, if an overflow occurred since the
+ * last call.  The consumer must then collect status changes itself. */
+bool reap_ring_test_and_clear_overflow(void);
+
+#endif /* __REAP_RING_H */
@@ -36,6 +36,7 @@ struct ast_pipeline * ast_pipeline_create(char *iored_input,
     pipe->iored_input = iored_input;
     pipe->append_to_output = append_to_output;
     pipe->bg_job = false;
+    pipe->timed = false;
     return pipe;
 }
 
@@ -106,6 +107,9 @@ ast_pipeline_print(struct ast_pipeline *pipe)
     if (pipe->iored_input)
         printf("  stdin of the first command reads from %s\n", pipe->iored_input);
 
+    if (pipe->timed)
+        printf("  - its resource usage should be reported\n");
+
     if (pipe->bg_job)
         printf("  - is a background job\n");
     else
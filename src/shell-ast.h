@@ -24,6 +24,7 @@ struct ast_pipeline {
                                 file 'iored_output' */
     bool append_to_output;   /* True if user typed >> to append */
     bool bg_job;             /* True if user entered & */
+    bool timed;              /* True if prefixed with the 'time' keyword */
     struct list_elem elem;   /* Link element. */
 };
 
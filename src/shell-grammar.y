@@ -203,6 +203,17 @@ ast_pipeline: pipeline {
                 free(cmd);
             }
             free(pipe);
+
+            /* 'time pipeline': the keyword is recognized only in
+             * command position and only if a command follows it. */
+            struct ast_command * cmd;
+            cmd = list_entry(list_front(&$$->commands), struct ast_command, elem);
+            if (!strcmp(cmd->argv[0], "time") && cmd->argv[1] != NULL) {
+                free(cmd->argv[0]);
+                for (char **p = cmd->argv; (p[0] = p[1]) != NULL; p++)
+                    ;
+                $$->timed = true;
+            }
         }
 
 pipeline: command {
@@ -11,6 +11,7 @@
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/signalfd.h>
 
 #include "signal_support.h"
 #include "utils.h"
@@ -83,3 +84,20 @@ signal_set_handler(int sig, sa_sigaction_t handler)
     if (sigaction(sig, &sa, NULL) != 0)
         utils_fatal_error("sigaction failed for signal %d", sig);
 }
+
+/* Block signal 'sig' and return a non-blocking signalfd that
+ * becomes readable when it is pending.  The signal must remain
+ * blocked for as long as the fd is used. */
+int
+signal_create_fd(int sig)
+{
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, sig);
+    signal_block(sig);
+
+    int fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (fd == -1)
+        utils_fatal_error("signalfd failed for signal %d: ", sig);
+    return fd;
+}
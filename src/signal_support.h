@@ -19,4 +19,8 @@ bool signal_unblock(int sig);
 /* Install signal handler for signal 'sig' */
 void signal_set_handler(int sig, sa_sigaction_t handler);
 
+/* Block signal 'sig' and return a non-blocking signalfd that
+ * becomes readable when it is pending. */
+int signal_create_fd(int sig);
+
 #endif /* __SIGNAL_SUPPORT_H */
@@ -0,0 +1,283 @@
+/*
+ * A cache of spawn templates, kept in most recently used order.
+ *
+ * Templates are found by comparing serialized pipelines.  The list
+ * is short enough that a linear scan, which compares hashes before
+ * keys, costs far less than building a template would.
+ */
+#define _GNU_SOURCE    1
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <termios.h>
+
+#include "spawn_template.h"
+#include "path_cache.h"
+#include "termstate_management.h"
+#include "utils.h"
+
+/* Number of templates kept */
+#define SPAWN_TEMPLATE_CACHE_SIZE 32
+
+static struct list templates;  /* most recently used first */
+static bool templates_initialized;
+static size_t ntemplates;
+
+/* Buffer the key of the pipeline being looked up is built in */
+static char *keybuf;
+static size_t keylen, keycapacity;
+
+static void
+key_append(const void *data, size_t len)
+{
+    if (keylen + len > keycapacity) {
+        keycapacity = 2 * (keylen + len);
+        keybuf = realloc(keybuf, keycapacity);
+        if (keybuf == NULL)
+            utils_fatal_error("cannot allocate spawn template key: ");
+    }
+    memcpy(keybuf + keylen, data, len);
+    keylen += len;
+}
+
+/* Append a string including its terminating NUL, preceded by a tag
+ * byte so that NULL and "" differ */
+static void
+key_append_string(const char *s)
+{
+    key_append(s ? "s" : "-", 1);
+    key_append(s ? s : "", s ? strlen(s) + 1 : 1);
+}
+
+/* Serialize everything about 'pipe' that a template depends on */
+static void
+pipeline_key(struct ast_pipeline *pipe, bool capture_output)
+{
+    char flags[] = { pipe->bg_job, pipe->append_to_output, capture_output };
+
+    keylen = 0;
+    key_append(flags, sizeof flags);
+    key_append_string(pipe->iored_input);
+    key_append_string(pipe->iored_output);
+    for (struct list_elem *e = list_begin(&pipe->commands);
+         e != list_end(&pipe->commands); e = list_next(e)) {
+        struct ast_command *cmd = list_entry(e, struct ast_command, elem);
+        key_append(cmd->dup_stderr_to_stdout ? "|&" : "| ", 2);
+        for (char **arg = cmd->argv; *arg; arg++)
+            key_append_string(*arg);
+    }
+}
+
+static uint32_t
+key_hash(const char *key, size_t len)
+{
+    uint32_t h = 2166136261u;
+    while (len-- > 0)
+        h = (h ^ (unsigned char) *key++) * 16777619u;
+    return h;
+}
+
+static void
+spawn_template_destroy(struct spawn_template *t)
+{
+    for (int i = 0; i < t->nstages; i++) {
+        struct spawn_stage *stage = &t->stages[i];
+        posix_spawnattr_destroy(&stage->attr);
+        posix_spawn_file_actions_destroy(&stage->actions);
+        free(stage->name);
+        free(stage->path);
+    }
+    free(t->key);
+    free(t);
+}
+
+/* Add the actions and attributes that stage 'i' of 'pipe', which runs
+ * 'cmd', needs for every spawn */
+static void
+spawn_stage_init(struct spawn_stage *stage, struct ast_pipeline *pipe,
+                 struct ast_command *cmd, int i, int nstages,
+                 bool capture_output)
+{
+    posix_spawn_file_actions_t *actions = &stage->actions;
+    int nactions = 0;
+
+    posix_spawnattr_init(&stage->attr);
+    posix_spawn_file_actions_init(actions);
+
+    //Children must not inherit the shell's blocked SIGCHLD
+    sigset_t child_sigmask;
+    sigemptyset(&child_sigmask);
+    posix_spawnattr_setsigmask(&stage->attr, &child_sigmask);
+
+    //Foreground jobs are given the terminal before they exec
+    short flags = POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK;
+    if (!pipe->bg_job)
+        flags |= POSIX_SPAWN_TCSETPGROUP;
+    posix_spawnattr_tcsetpgrp_np(&stage->attr, termstate_get_tty_fd());
+    posix_spawnattr_setflags(&stage->attr, flags);
+
+    //IO Redirection
+    if (pipe->iored_input != NULL && i == 0) {
+        posix_spawn_file_actions_addopen(actions, 0, pipe->iored_input,
+                O_RDONLY, S_IRWXU | S_IRWXG | S_IRWXO);
+        nactions++;
+    }
+    if (pipe->iored_output != NULL && i == nstages - 1) {
+        int flag = O_CREAT | O_WRONLY;
+        flag |= pipe->append_to_output ? O_APPEND : O_TRUNC;
+        posix_spawn_file_actions_addopen(actions, 1, pipe->iored_output,
+                flag, S_IRWXU | S_IRWXG | S_IRWXO);
+        nactions++;
+    }
+
+    //Pipe ends are not known yet; spawn_stage_prepare() fills them in
+    stage->stdin_action = stage->stdout_action = -1;
+    if (i > 0) {
+        posix_spawn_file_actions_adddup2(actions, 0, 0);
+        stage->stdin_action = nactions++;
+    }
+    if (i < nstages - 1 || capture_output) {
+        posix_spawn_file_actions_adddup2(actions, 1, 1);
+        stage->stdout_action = nactions++;
+    }
+
+    if (cmd->dup_stderr_to_stdout)
+        posix_spawn_file_actions_adddup2(actions, 1, 2);
+
+    //Close every other inherited fd, so that a stray pipe end
+    //left open without O_CLOEXEC cannot keep a reader from seeing EOF
+    posix_spawn_file_actions_addclosefrom_np(actions, 3);
+
+    stage->name = strdup(cmd->argv[0]);
+    if (stage->name == NULL)
+        utils_fatal_error("cannot allocate spawn template: ");
+    stage->path = NULL;
+    stage->path_generation = path_cache_generation() - 1;
+}
+
+static struct spawn_template *
+spawn_template_build(struct ast_pipeline *pipe, uint32_t hash,
+                     bool capture_output)
+{
+    int nstages = list_size(&pipe->commands);
+    struct spawn_template *t = malloc(sizeof *t
+                                      + nstages * sizeof t->stages[0]);
+    if (t == NULL)
+        utils_fatal_error("cannot allocate spawn template: ");
+
+    t->key = malloc(keylen);
+    if (t->key == NULL)
+        utils_fatal_error("cannot allocate spawn template: ");
+    memcpy(t->key, keybuf, keylen);
+    t->keylen = keylen;
+    t->hash = hash;
+    t->nstages = nstages;
+
+    int i = 0;
+    for (struct list_elem *e = list_begin(&pipe->commands);
+         e != list_end(&pipe->commands); e = list_next(e), i++)
+        spawn_stage_init(&t->stages[i], pipe,
+                         list_entry(e, struct ast_command, elem), i, nstages,
+                         capture_output);
+    return t;
+}
+
+struct spawn_template *
+spawn_template_get(struct ast_pipeline *pipe, bool capture_output)
+{
+    if (!templates_initialized) {
+        list_init(&templates);
+        templates_initialized = true;
+    }
+
+    pipeline_key(pipe, capture_output);
+    uint32_t hash = key_hash(keybuf, keylen);
+
+    for (struct list_elem *e = list_begin(&templates);
+         e != list_end(&templates); e = list_next(e)) {
+        struct spawn_template *t = list_entry(e, struct spawn_template, elem);
+        if (t->hash == hash && t->keylen == keylen
+            && memcmp(t->key, keybuf, keylen) == 0) {
+            list_remove(e);
+            list_push_front(&templates, e);
+            return t;
+        }
+    }
+
+    if (ntemplates == SPAWN_TEMPLATE_CACHE_SIZE) {
+        struct list_elem *lru = list_pop_back(&templates);
+        spawn_template_destroy(list_entry(lru, struct spawn_template, elem));
+        ntemplates--;
+    }
+
+    struct spawn_template *t = spawn_template_build(pipe, hash,
+                                                    capture_output);
+    list_push_front(&templates, &t->elem);
+    ntemplates++;
+    return t;
+}
+
+const char *
+spawn_stage_prepare(struct spawn_stage *stage, pid_t pgid,
+                    int in_fd, int out_fd, int *pidfd)
+{
+    posix_spawnattr_setpgroup(&stage->attr, pgid);
+    posix_spawnattr_setpidfd_np(&stage->attr, pidfd);
+    if (stage->stdin_action != -1)
+        posix_spawn_file_actions_setdup2_np(&stage->actions,
+                                            stage->stdin_action, in_fd);
+    if (stage->stdout_action != -1)
+        posix_spawn_file_actions_setdup2_np(&stage->actions,
+                                            stage->stdout_action, out_fd);
+
+    unsigned generation = path_cache_generation();
+    if (stage->path_generation != generation) {
+        const char *path = path_cache_lookup(stage->name);
+        free(stage->path);
+        stage->path = path ? strdup(path) : NULL;
+        stage->path_generation = generation;
+    }
+    return stage->path;
+}
+
+void
+spawn_stage_set_affinity(struct spawn_stage *stage, const cpu_set_t *cpus)
+{
+    short flags;
+    posix_spawnattr_getflags(&stage->attr, &flags);
+    if (cpus != NULL) {
+        posix_spawnattr_setaffinity_np(&stage->attr, sizeof *cpus, cpus);
+        flags |= POSIX_SPAWN_SETAFFINITY;
+    } else
+        flags &= ~POSIX_SPAWN_SETAFFINITY;
+    posix_spawnattr_setflags(&stage->attr, flags);
+}
+
+void
+spawn_stage_set_scheduler(struct spawn_stage *stage, int policy)
+{
+    short flags;
+    posix_spawnattr_getflags(&stage->attr, &flags);
+    if (policy != -1) {
+        posix_spawnattr_setschedpolicy(&stage->attr, policy);
+        flags |= POSIX_SPAWN_SETSCHEDULER;
+    } else
+        flags &= ~POSIX_SPAWN_SETSCHEDULER;
+    posix_spawnattr_setflags(&stage->attr, flags);
+}
+
+void
+spawn_stage_set_cgroup(struct spawn_stage *stage, int fd)
+{
+    short flags;
+    posix_spawnattr_getflags(&stage->attr, &flags);
+    if (fd != -1) {
+        posix_spawnattr_setcgroup_np(&stage->attr, fd);
+        flags |= POSIX_SPAWN_SETCGROUP;
+    } else
+        flags &= ~POSIX_SPAWN_SETCGROUP;
+    posix_spawnattr_setflags(&stage->attr, flags);
+}
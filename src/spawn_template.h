@@ -0,0 +1,74 @@
+#ifndef __SPAWN_TEMPLATE_H
+#define __SPAWN_TEMPLATE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "spawn.h"
+#include "list.h"
+#include "shell-ast.h"
+
+/*
+ * Prebuilt posix_spawn() arguments for each stage of a pipeline.
+ *
+ * Setting up a stage takes a dozen calls: initializing the attributes
+ * and file actions, adding the redirections, pipe ends and closefrom,
+ * and resolving the command.  Everything but the process group, the
+ * pidfd and the pipe ends depends only on the text of the pipeline,
+ * so it is done once and cached, keyed by that text.  Running the
+ * same pipeline again, e.g., from history, a loop or the bench
+ * builtin, only patches those three in.
+ *
+ * A bounded number of templates is kept; the least recently used one
+ * is destroyed when room for another is needed.
+ */
+struct spawn_stage {
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_t actions;
+    int stdin_action;           /* Index of the dup2 from the previous
+                                   stage's pipe, -1 if none */
+    int stdout_action;          /* Index of the dup2 to the next
+                                   stage's pipe, or of the last stage
+                                   to a captured stdout, -1 if none */
+    char *name;                 /* Command as typed */
+    char *path;                 /* Resolved command, NULL if not found */
+    unsigned path_generation;   /* path_cache_generation() of 'path' */
+};
+
+struct spawn_template {
+    struct list_elem elem;      /* Link element for the cache */
+    char *key;                  /* Serialized pipeline */
+    size_t keylen;
+    uint32_t hash;              /* Hash of 'key' */
+    int nstages;
+    struct spawn_stage stages[];
+};
+
+/* Return the template for 'pipe', building it if it is not cached.
+ * If 'capture_output', the last stage writes to a descriptor passed
+ * as its 'out_fd' like the other stages do.  It remains valid until
+ * the next call. */
+struct spawn_template * spawn_template_get(struct ast_pipeline *pipe,
+                                           bool capture_output);
+
+/* Prepare 'stage' for a spawn into process group 'pgid' (0 for a new
+ * one) reading from 'in_fd' and writing to 'out_fd', where -1 means
+ * the stage has no pipe on that side, and that stores its pidfd in
+ * '*pidfd'.  Returns the path to spawn, or NULL if the command does
+ * not exist. */
+const char * spawn_stage_prepare(struct spawn_stage *stage, pid_t pgid,
+                                 int in_fd, int out_fd, int *pidfd);
+
+/* Restrict the next spawn of 'stage' to 'cpus', or lift the
+ * restriction if it is NULL.  'cpus' must remain valid until then. */
+void spawn_stage_set_affinity(struct spawn_stage *stage, const cpu_set_t *cpus);
+
+/* Spawn 'stage' in scheduling class 'policy' next time, or in the
+ * shell's if it is -1 */
+void spawn_stage_set_scheduler(struct spawn_stage *stage, int policy);
+
+/* Spawn 'stage' into the cgroup whose directory is open as 'fd' next
+ * time, or into the shell's if it is -1 */
+void spawn_stage_set_cgroup(struct spawn_stage *stage, int fd);
+
+#endif /* __SPAWN_TEMPLATE_H */
@@ -0,0 +1,45 @@
+#!/usr/bin/python
+#
+# Tests subreaper mode (cush -r): a process that a job's leader leaves
+# behind in its process group is adopted, keeps the job running until
+# it exits, and is reaped rather than left as a zombie.
+#
+import atexit, proc_check, time, os, tempfile
+from testutils import *
+
+# a job whose leader exits right away, leaving a sleep behind
+fd, script = tempfile.mkstemp(suffix=".sh")
+os.write(fd, "sleep 2 &\necho leader done\n")
+os.close(fd)
+atexit.register(os.remove, script)
+
+console = setup_tests([" -r"])
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+start = time.time()
+sendline("sh %s &" % script)
+(jid, pid) = parse_bg_status()
+expect_exact("leader done", "the job did not run")
+time.sleep(0.5)
+
+sendline("jobs -l")
+expect(r"\[%s\]\s+Running" % jid, "job is not running after its leader exited")
+expect_exact("adopted 1 process left behind", "the orphan was not adopted")
+expect_prompt()
+
+assert console.expect(r"\[%s\]\s+Done" % jid, timeout=10) == 0, \
+    "job was not done when the orphan exited"
+assert time.time() - start > 1.5, "job was done before the orphan exited"
+
+# the orphan was reaped
+children = open("/proc/%d/task/%d/children" % (console.pid, console.pid)).read()
+for child in children.split():
+    state = open("/proc/%s/stat" % child).read().rsplit(")", 1)[1].split()[0]
+    assert state != "Z", "a zombie was left behind"
+
+sendline("exit")
+expect_exact("exit\r\n", "Shell output extraneous characters")
+
+test_success()
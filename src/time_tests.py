@@ -0,0 +1,31 @@
+#!/usr/bin/python
+#
+# Tests that the 'time' keyword reports the wall clock and CPU time
+# of a pipeline and the shell's own overhead.
+#
+import atexit, proc_check, time
+from testutils import *
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+# time a pipeline; the keyword itself must not be run
+sendline("time sleep 0.5 | cat")
+expect(r"real\s+0\.5\d\ds", "wall clock time not reported")
+expect(r"user\s+\d+\.\d{3}s", "user time not reported")
+expect(r"sys\s+\d+\.\d{3}s", "system time not reported")
+expect(r"shell\s+\d+\.\d{3}ms to spawn, \d+\.\d{3}ms to prompt",
+       "shell overhead not reported")
+expect_prompt()
+
+# 'time' is an ordinary word anywhere but in command position
+sendline("echo time")
+expect(r"\rtime\r\n", "'time' argument was consumed")
+expect_prompt()
+
+sendline("exit")
+expect_exact("exit\r\n", "Shell output extraneous characters")
+
+test_success()
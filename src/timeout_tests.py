@@ -0,0 +1,65 @@
+#!/usr/bin/python
+#
+# Tests the timeout builtin and limit time=: jobs are terminated once
+# their time is up, including many background jobs at once.
+#
+import atexit, proc_check, time
+from testutils import *
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+sendline("timeout soon sleep 1")
+expect_exact("usage", "timeout accepted an invalid duration")
+expect_prompt()
+
+# a foreground job is terminated once its time is up
+start = time.time()
+sendline("timeout 1 sleep 30")
+expect_exact("Terminated", "foreground job was not terminated")
+expect_prompt()
+assert time.time() - start < 5, "foreground job was terminated too late"
+
+# a job that ends in time is left alone
+sendline("timeout 5 sleep 0.1")
+expect_prompt("job that ended in time was not left alone")
+assert "Terminated" not in console.before, "job that ended in time was terminated"
+
+# limit time= applies to a running background job
+sendline("sleep 30 &")
+(jid, pid) = parse_bg_status()
+expect_prompt()
+sendline("limit %%%s time=fast" % jid)
+expect_exact("invalid duration", "limit accepted an invalid duration")
+expect_prompt()
+start = time.time()
+sendline("limit %%%s time=1500ms" % jid)
+expect_prompt()
+expect_exact("Terminated", "background job was not terminated")
+expect_prompt()
+assert time.time() - start < 5, "background job was terminated too late"
+# let readline redraw its line after the notice before typing again
+time.sleep(0.5)
+
+# many background jobs with deadlines are all terminated
+for i in range(20):
+    sendline("timeout 3 sleep 30 &")
+    parse_bg_status()
+    expect_prompt()
+# the last of them is terminated 3 seconds after it was started
+sendline("wait")
+assert console.expect(r"wait: (\d+) of \1 jobs failed", timeout=10) == 0, \
+    "background jobs were not terminated"
+expect_prompt()
+sendline("jobs")
+expect_prompt()
+assert "Running" not in console.before, "a job is still running"
+# let readline redraw its line after the notices before typing again
+time.sleep(0.5)
+
+sendline("exit")
+expect_exact("exit\r\n", "Shell output extraneous characters")
+
+test_success()
@@ -1,5 +1,5 @@
 /*
- * Utility functions for printing error messages
+ * Utility functions for printing error messages, and for sizes
  */
 
 #include <termios.h>
@@ -10,6 +10,7 @@
 #include <stdarg.h>
 #include <fcntl.h>
 #include <assert.h>
+#include <ctype.h>
 
 #include "utils.h"
 
@@ -57,3 +58,49 @@ utils_set_cloexec(int fd)
     return fcntl(fd, F_SETFD, oldflags | FD_CLOEXEC);
 }
 
+
+/* Parse a size such as "512K", "100M" or "2G" (bytes if no suffix).
+ * Returns false if it is malformed or does not fit in 64 bits. */
+bool
+utils_parse_size(const char *s, uint64_t *bytes)
+{
+    static const char suffixes[] = "KMGT";
+    if (!isdigit((unsigned char) *s))
+        return false;
+
+    char *end;
+    errno = 0;
+    uint64_t value = strtoull(s, &end, 10);
+    if (errno == ERANGE)
+        return false;
+
+    if (*end != '\0') {
+        const char *suffix = strchr(suffixes, *end);
+        if (suffix == NULL || end[1] != '\0')
+            return false;
+        for (int i = 0; i <= suffix - suffixes; i++) {
+            if (value > UINT64_MAX / 1024)
+                return false;
+            value *= 1024;
+        }
+    }
+    *bytes = value;
+    return true;
+}
+
+/* Format 'bytes' with the largest suffix that leaves at least 1 */
+void
+utils_format_size(char *buf, size_t size, uint64_t bytes)
+{
+    static const char suffixes[] = "KMGT";
+    double value = bytes;
+    int i = -1;
+    while (i < 3 && value >= 1024) {
+        value /= 1024;
+        i++;
+    }
+    if (i == -1)
+        snprintf(buf, size, "%llu", (unsigned long long) bytes);
+    else
+        snprintf(buf, size, "%.*f%c", value < 10 ? 1 : 0, value, suffixes[i]);
+}
@@ -1,3 +1,7 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
 /* Set the 'close-on-exec' flag on fd, return error indicator */
 int utils_set_cloexec(int fd);
 
@@ -6,3 +10,10 @@ void utils_error(char *fmt, ...);
 
 /* Print information about the last syscall error and then exit */
 void utils_fatal_error(char *fmt, ...);
+
+/* Parse a size such as "512K", "100M" or "2G" (bytes if no suffix).
+ * Returns false if it is malformed or does not fit in 64 bits. */
+bool utils_parse_size(const char *s, uint64_t *bytes);
+
+/* Format 'bytes' with the largest suffix that leaves at least 1 */
+void utils_format_size(char *buf, size_t size, uint64_t bytes);
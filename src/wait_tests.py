@@ -0,0 +1,75 @@
+#!/usr/bin/python
+#
+# Tests the wait builtin: waiting for all background jobs, for a
+# given one, for any one with -n, the failure count and ^C.
+#
+import atexit, proc_check, time
+from testutils import *
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+# without background jobs, wait returns right away
+sendline("wait")
+expect_prompt("wait without jobs did not return")
+
+sendline("wait %42")
+expect_exact("no such job", "wait accepted a job that does not exist")
+expect_prompt()
+
+# wait for all of them; the one that exits with 1 is counted as failed
+# (jobs that were done before wait started are not counted at all)
+jids = []
+for i in range(20):
+    sendline("sleep 1 &")
+    (jid, pid) = parse_bg_status()
+    jids.append(jid)
+    expect_prompt()
+sendline("sleep 1 | false &")
+(failing, pid) = parse_bg_status()
+expect_prompt()
+
+sendline("wait")
+expect(r"wait: 1 of \d+ jobs failed", "wait did not report the failed job")
+expect_prompt()
+sendline("jobs")
+expect_prompt("jobs are still listed after wait")
+assert "Running" not in console.before, "a job is still running after wait"
+
+# wait -n returns as soon as one of them is done
+sendline("sleep 1 &")
+(short, pid) = parse_bg_status()
+expect_prompt()
+sendline("sleep 30 &")
+(long, pid) = parse_bg_status()
+expect_prompt()
+
+start = time.time()
+sendline("wait -n")
+expect_prompt("wait -n did not return")
+assert time.time() - start < 5, "wait -n waited for all jobs"
+sendline("jobs")
+expect(r"\[%s\]\s+Running" % long, "long job is not running")
+expect_prompt()
+
+# ^C ends the wait and leaves the job running
+sendline("wait %" + long)
+time.sleep(0.5)
+console.sendintr()
+expect_prompt("^C did not end wait")
+sendline("jobs")
+expect(r"\[%s\]\s+Running" % long, "long job is not running after ^C")
+expect_prompt()
+
+run_builtin("kill", long)
+expect_exact("Terminated", "killed job was not reported")
+expect_prompt()
+# let readline redraw its line after the notice before typing again
+time.sleep(0.5)
+
+sendline("exit")
+expect_exact("exit\r\n", "Shell output extraneous characters")
+
+test_success()
@@ -0,0 +1,156 @@
+/*
+ * Thresholds of the runaway job watchdog, and sampling of processes.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "watchdog.h"
+#include "deadline.h"
+#include "utils.h"
+
+#define NSEC_PER_SEC 1000000000ull
+
+static uint64_t interval = NSEC_PER_SEC;
+static uint64_t max_rss;        /* bytes, 0 for no limit */
+static uint64_t max_cpu;        /* ns, 0 for no limit */
+
+static const struct {
+    const char *name;
+    int signal;
+} actions[] = {
+    { "stop", SIGSTOP }, { "term", SIGTERM }, { "kill", SIGKILL },
+};
+static int action;              /* index into actions */
+
+bool
+watchdog_parse(char **argv)
+{
+    uint64_t newinterval = interval, newrss = max_rss, newcpu = max_cpu;
+    int newaction = action;
+
+    for (; *argv != NULL; argv++) {
+        if (strcmp(*argv, "off") == 0) {
+            newrss = newcpu = 0;
+        } else if (strncmp(*argv, "every=", 6) == 0) {
+            if (!deadline_parse_duration(*argv + 6, &newinterval)
+                || newinterval < NSEC_PER_SEC / 100)
+                return false;
+        } else if (strncmp(*argv, "rss=", 4) == 0) {
+            if (!utils_parse_size(*argv + 4, &newrss))
+                return false;
+        } else if (strncmp(*argv, "cpu=", 4) == 0) {
+            if (!deadline_parse_duration(*argv + 4, &newcpu))
+                return false;
+        } else if (strncmp(*argv, "action=", 7) == 0) {
+            newaction = -1;
+            for (int i = 0; i < sizeof actions / sizeof actions[0]; i++)
+                if (strcmp(*argv + 7, actions[i].name) == 0)
+                    newaction = i;
+            if (newaction == -1)
+                return false;
+        } else
+            return false;
+    }
+    interval = newinterval;
+    max_rss = newrss;
+    max_cpu = newcpu;
+    action = newaction;
+    return true;
+}
+
+void
+watchdog_print(void)
+{
+    char rss[32];
+    printf("watchdog:");
+    if (!watchdog_enabled())
+        printf(" off");
+    if (max_rss > 0) {
+        utils_format_size(rss, sizeof rss, max_rss);
+        printf(" rss=%s", rss);
+    }
+    if (max_cpu > 0)
+        printf(" cpu=%.3gs", (double) max_cpu / NSEC_PER_SEC);
+    printf(" every=%.3gs action=%s\n", (double) interval / NSEC_PER_SEC,
+           actions[action].name);
+}
+
+bool
+watchdog_enabled(void)
+{
+    return max_rss > 0 || max_cpu > 0;
+}
+
+uint64_t
+watchdog_interval(void)
+{
+    return interval;
+}
+
+bool
+watchdog_sample(pid_t pid, int *fd, struct watchdog_sample *s)
+{
+    static long hz, pagesize;
+    if (hz == 0) {
+        hz = sysconf(_SC_CLK_TCK);
+        pagesize = sysconf(_SC_PAGESIZE);
+    }
+
+    if (*fd == -1) {
+        char path[64];
+        snprintf(path, sizeof path, "/proc/%d/stat", pid);
+        *fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (*fd == -1)
+            return false;
+    }
+
+    char buf[1024];
+    ssize_t n = pread(*fd, buf, sizeof buf - 1, 0);
+    if (n <= 0)
+        return false;
+    buf[n] = '\0';
+
+    /* The command name (field 2) may contain spaces and parentheses,
+     * so start parsing after the last ')'. */
+    char *p = strrchr(buf, ')');
+    unsigned long long utime, stime;
+    long rss;
+    if (p == NULL
+        || sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u "
+                  "%llu %llu %*d %*d %*d %*d %*d %*d %*u %*u %ld",
+                  &utime, &stime, &rss) != 3)
+        return false;
+
+    s->cpu = (utime + stime) * NSEC_PER_SEC / hz;
+    s->rss = rss > 0 ? (uint64_t) rss * pagesize : 0;
+    return true;
+}
+
+bool
+watchdog_exceeded(const struct watchdog_sample *total, char *why, size_t size)
+{
+    char used[32], limit[32];
+    if (max_rss > 0 && total->rss > max_rss) {
+        utils_format_size(used, sizeof used, total->rss);
+        utils_format_size(limit, sizeof limit, max_rss);
+        snprintf(why, size, "rss %s > %s", used, limit);
+        return true;
+    }
+    if (max_cpu > 0 && total->cpu > max_cpu) {
+        snprintf(why, size, "cpu %.3gs > %.3gs",
+                 (double) total->cpu / NSEC_PER_SEC,
+                 (double) max_cpu / NSEC_PER_SEC);
+        return true;
+    }
+    return false;
+}
+
+int
+watchdog_signal(void)
+{
+    return actions[action].signal;
+}
@@ -0,0 +1,54 @@
+#ifndef __WATCHDOG_H
+#define __WATCHDOG_H
+
+#include <sys/types.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A watchdog for runaway jobs.
+ *
+ * At a fixed interval the shell samples the resident set size and CPU
+ * time of every live process it spawned and adds them up per job.  A
+ * job that is over the RSS or the CPU time threshold is stopped or
+ * sent a signal.  Both numbers are found in /proc/<pid>/stat, which is
+ * opened once per process and then read with a single pread() per
+ * sample.
+ */
+
+/* Usage of a process, or of all live processes of a job */
+struct watchdog_sample {
+    uint64_t rss;               /* Resident set size in bytes */
+    uint64_t cpu;               /* User plus system CPU time in ns */
+};
+
+/* Set the thresholds from the arguments of the watchdog builtin, i.e.
+ * [off] [every=DURATION] [rss=SIZE] [cpu=DURATION]
+ * [action=stop|term|kill].  Returns false if they are invalid. */
+bool watchdog_parse(char **argv);
+
+/* Print the settings */
+void watchdog_print(void);
+
+/* Return true if a threshold is set */
+bool watchdog_enabled(void);
+
+/* Return the sampling interval in ns */
+uint64_t watchdog_interval(void);
+
+/* Sample the live process 'pid' into '*s'.  '*fd' caches its stat
+ * file; if it is -1, the file is opened.  The caller closes it once
+ * the process has been reaped.  Returns false if the process could
+ * not be sampled. */
+bool watchdog_sample(pid_t pid, int *fd, struct watchdog_sample *s);
+
+/* Return true if a job whose processes use 'total' is over a
+ * threshold, and describe what it is over in 'why' */
+bool watchdog_exceeded(const struct watchdog_sample *total,
+                       char *why, size_t size);
+
+/* Return the signal a job over a threshold is sent */
+int watchdog_signal(void);
+
+#endif /* __WATCHDOG_H */
@@ -0,0 +1,71 @@
+#!/usr/bin/python
+#
+# Tests the watchdog builtin: jobs over the CPU time or RSS threshold
+# are signalled or stopped once, and marked in the jobs listing.
+#
+import atexit, proc_check, time
+from testutils import *
+
+console = setup_tests()
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+sendline("watchdog")
+expect_exact("watchdog: off", "watchdog did not print its settings")
+expect_prompt()
+
+sendline("watchdog rss=plenty")
+expect_exact("usage", "watchdog accepted an invalid size")
+expect_prompt()
+
+# a job that uses more than 1s of CPU time is terminated
+sendline("watchdog every=200ms cpu=1s action=term")
+expect_prompt()
+sendline("yes > /dev/null &")
+(jid, pid) = parse_bg_status()
+expect_prompt()
+assert console.expect(r"\[%s\]\s+watchdog: cpu [\d.]+s > 1s, sending SIGTERM" % jid,
+                      timeout=10) == 0, "CPU hog was not caught"
+expect_exact("Terminated", "CPU hog was not terminated")
+expect_prompt()
+# let readline redraw its line after the notice before typing again
+time.sleep(0.5)
+
+# any process is over 100K, and is stopped
+sendline("watchdog cpu=0 rss=100K action=stop")
+expect_prompt()
+sendline("watchdog")
+expect_exact("watchdog: rss=100K every=0.2s action=stop",
+             "watchdog did not print its settings")
+expect_prompt()
+sendline("sleep 30 &")
+(jid, pid) = parse_bg_status()
+expect_prompt()
+expect(r"\[%s\]\s+watchdog: rss \S+ > 100K, sending SIGSTOP" % jid,
+       "job over the RSS threshold was not caught")
+expect_prompt()
+time.sleep(0.5)
+sendline("jobs")
+expect(r"\[%s\]\s+Stopped\s+\(sleep 30\) \[watchdog: rss \S+ > 100K\]" % jid,
+       "stopped job is not marked")
+expect_prompt()
+
+# once continued, it is left alone
+run_builtin("bg", jid)
+expect_prompt()
+time.sleep(1)
+sendline("jobs")
+expect(r"\[%s\]\s+Running" % jid, "job was stopped again")
+expect_prompt()
+
+run_builtin("kill", jid)
+expect_exact("Terminated", "killed job was not reported")
+expect_prompt()
+# let readline redraw its line after the notice before typing again
+time.sleep(0.5)
+
+sendline("exit")
+expect_exact("exit\r\n", "Shell output extraneous characters")
+
+test_success()
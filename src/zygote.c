@@ -0,0 +1,416 @@
+/*
+ * The spawner helper, and the protocol the shell uses to talk to it.
+ *
+ * A request is a single SOCK_SEQPACKET message: a fixed header
+ * followed by NUL-terminated strings, namely the path, the input and
+ * output files if there are any, and the arguments.  The descriptors
+ * the child needs are attached as SCM_RIGHTS, in the order terminal,
+ * pipe in, pipe out, cgroup, each only if the header says it is
+ * present, and last the shell's current directory, which relative
+ * paths in the request are resolved against.
+ * The reply is an error number and pid, with the pidfd attached if
+ * one was created.
+ */
+#define _GNU_SOURCE    1
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+#include "spawn.h"
+
+#include "zygote.h"
+#include "termstate_management.h"
+#include "utils.h"
+
+extern char **environ;
+
+#define ZYGOTE_FOREGROUND   0x01
+#define ZYGOTE_DUP_STDERR   0x02
+#define ZYGOTE_PIPE_IN      0x04
+#define ZYGOTE_PIPE_OUT     0x08
+#define ZYGOTE_INPUT        0x10
+#define ZYGOTE_OUTPUT       0x20
+#define ZYGOTE_APPEND       0x40
+#define ZYGOTE_AFFINITY     0x80
+#define ZYGOTE_SCHEDULER    0x100
+#define ZYGOTE_CGROUP       0x200
+
+/* Largest request; stages with longer arguments fail with E2BIG */
+#define ZYGOTE_MAX_REQUEST  65536
+
+/* Most descriptors passed along with a request */
+#define ZYGOTE_MAX_FDS      5
+
+struct zygote_request {
+    pid_t pgid;                 /* Process group to join, 0 for a new one */
+    int flags;                  /* ZYGOTE_* */
+    int argc;                   /* Number of arguments among the strings */
+    cpu_set_t cpus;             /* CPUs to run on, if ZYGOTE_AFFINITY */
+    int policy;                 /* Class to run in, if ZYGOTE_SCHEDULER */
+};
+
+struct zygote_reply {
+    int error;                  /* 0, or why the spawn failed */
+    pid_t pid;                  /* The child, if one was created */
+};
+
+static int zygote_sock = -1;    /* The shell's end, -1 if not running */
+static pid_t zygote_child = -1; /* The helper, -1 if not started or reaped */
+
+/* Send 'len' bytes from 'buf' with 'nfds' descriptors attached */
+static ssize_t
+send_with_fds(int sock, const void *buf, size_t len, const int *fds, int nfds)
+{
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(ZYGOTE_MAX_FDS * sizeof(int))];
+    } control;
+    struct iovec iov = { .iov_base = (void *) buf, .iov_len = len };
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+
+    if (nfds > 0) {
+        msg.msg_control = control.buf;
+        msg.msg_controllen = CMSG_SPACE(nfds * sizeof(int));
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(nfds * sizeof(int));
+        memcpy(CMSG_DATA(cmsg), fds, nfds * sizeof(int));
+    }
+
+    ssize_t n;
+    while ((n = sendmsg(sock, &msg, MSG_NOSIGNAL)) == -1 && errno == EINTR)
+        continue;
+    return n;
+}
+
+/* Receive a message of up to 'len' bytes into 'buf', and the
+ * descriptors attached to it into 'fds'.  Returns its length, with
+ * the number of descriptors in '*nfds'. */
+static ssize_t
+recv_with_fds(int sock, void *buf, size_t len, int *fds, int *nfds)
+{
+    union {
+        struct cmsghdr align;
+        char buf[CMSG_SPACE(ZYGOTE_MAX_FDS * sizeof(int))];
+    } control;
+    struct iovec iov = { .iov_base = buf, .iov_len = len };
+    struct msghdr msg = {
+        .msg_iov = &iov, .msg_iovlen = 1,
+        .msg_control = control.buf, .msg_controllen = sizeof control.buf
+    };
+
+    ssize_t n;
+    while ((n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC)) == -1 && errno == EINTR)
+        continue;
+
+    *nfds = 0;
+    if (n == -1)
+        return -1;
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+            continue;
+        int count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        if (count > ZYGOTE_MAX_FDS - *nfds)
+            count = ZYGOTE_MAX_FDS - *nfds;
+        memcpy(fds + *nfds, CMSG_DATA(cmsg), count * sizeof(int));
+        *nfds += count;
+    }
+    return n;
+}
+
+/* Return the string at '*p' and advance past it, or NULL if there is
+ * none before 'end' */
+static char *
+next_string(char **p, char *end)
+{
+    char *s = *p;
+    if (s >= end)
+        return NULL;
+    *p += strlen(s) + 1;
+    return s;
+}
+
+/* Spawn the stage requested by the 'len' bytes in 'buf', whose
+ * descriptors are 'fds', and send the reply */
+static void
+zygote_serve(int sock, char *buf, size_t len, int *fds, int nfds)
+{
+    struct zygote_request *req = (struct zygote_request *) buf;
+    struct zygote_reply reply = { .error = EINVAL, .pid = 0 };
+    char **argv = NULL;
+    int pidfd = -1;
+
+    int expected = !!(req->flags & ZYGOTE_FOREGROUND)
+                 + !!(req->flags & ZYGOTE_PIPE_IN)
+                 + !!(req->flags & ZYGOTE_PIPE_OUT)
+                 + !!(req->flags & ZYGOTE_CGROUP) + 1;
+    if (len <= sizeof *req || buf[len - 1] != '\0' || nfds != expected
+        || req->argc < 1 || req->argc > len)
+        goto out;
+
+    char *p = buf + sizeof *req, *end = buf + len;
+    char *path = next_string(&p, end);
+    char *input = req->flags & ZYGOTE_INPUT ? next_string(&p, end) : NULL;
+    char *output = req->flags & ZYGOTE_OUTPUT ? next_string(&p, end) : NULL;
+    argv = malloc((req->argc + 1) * sizeof *argv);
+    if (argv == NULL) {
+        reply.error = ENOMEM;
+        goto out;
+    }
+    for (int i = 0; i < req->argc; i++)
+        if ((argv[i] = next_string(&p, end)) == NULL)
+            goto out;
+    argv[req->argc] = NULL;
+
+    int next_fd = 0;
+    int tty = req->flags & ZYGOTE_FOREGROUND ? fds[next_fd++] : -1;
+    int in_fd = req->flags & ZYGOTE_PIPE_IN ? fds[next_fd++] : -1;
+    int out_fd = req->flags & ZYGOTE_PIPE_OUT ? fds[next_fd++] : -1;
+    int cgroup = req->flags & ZYGOTE_CGROUP ? fds[next_fd++] : -1;
+    int cwd = fds[next_fd++];
+
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_init(&attr);
+    posix_spawn_file_actions_init(&actions);
+
+    sigset_t child_sigmask;
+    sigemptyset(&child_sigmask);
+    posix_spawnattr_setsigmask(&attr, &child_sigmask);
+    posix_spawnattr_setpgroup(&attr, req->pgid);
+    posix_spawnattr_setpidfd_np(&attr, &pidfd);
+
+    /* The child must be the shell's, not ours */
+    short flags = POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK
+                | POSIX_SPAWN_CLONE_PARENT;
+    if (tty != -1) {
+        posix_spawnattr_tcsetpgrp_np(&attr, tty);
+        flags |= POSIX_SPAWN_TCSETPGROUP;
+    }
+    if (req->flags & ZYGOTE_AFFINITY) {
+        posix_spawnattr_setaffinity_np(&attr, sizeof req->cpus, &req->cpus);
+        flags |= POSIX_SPAWN_SETAFFINITY;
+    }
+    if (req->flags & ZYGOTE_SCHEDULER) {
+        posix_spawnattr_setschedpolicy(&attr, req->policy);
+        flags |= POSIX_SPAWN_SETSCHEDULER;
+    }
+    if (cgroup != -1) {
+        posix_spawnattr_setcgroup_np(&attr, cgroup);
+        flags |= POSIX_SPAWN_SETCGROUP;
+    }
+    posix_spawnattr_setflags(&attr, flags);
+
+    /* The helper's own directory is where the shell was at startup;
+     * the child changes to the shell's before it opens any file.
+     * After that, the same actions, in the same order, as the shell's
+     * templates. */
+    posix_spawn_file_actions_addfchdir_np(&actions, cwd);
+    if (input != NULL)
+        posix_spawn_file_actions_addopen(&actions, 0, input,
+                O_RDONLY, S_IRWXU | S_IRWXG | S_IRWXO);
+    if (output != NULL)
+        posix_spawn_file_actions_addopen(&actions, 1, output,
+                O_CREAT | O_WRONLY
+                | (req->flags & ZYGOTE_APPEND ? O_APPEND : O_TRUNC),
+                S_IRWXU | S_IRWXG | S_IRWXO);
+    if (in_fd != -1)
+        posix_spawn_file_actions_adddup2(&actions, in_fd, 0);
+    if (out_fd != -1)
+        posix_spawn_file_actions_adddup2(&actions, out_fd, 1);
+    if (req->flags & ZYGOTE_DUP_STDERR)
+        posix_spawn_file_actions_adddup2(&actions, 1, 2);
+    posix_spawn_file_actions_addclosefrom_np(&actions, 3);
+
+    reply.error = posix_spawn(&reply.pid, path, &actions, &attr,
+                              argv, environ);
+
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+
+out:
+    free(argv);
+    if (send_with_fds(sock, &reply, sizeof reply, &pidfd, pidfd != -1) == -1)
+        _exit(EXIT_FAILURE);
+    if (pidfd != -1)
+        close(pidfd);
+    for (int i = 0; i < nfds; i++)
+        close(fds[i]);
+}
+
+static void __attribute__((noreturn))
+zygote_main(int sock, pid_t shell)
+{
+    /* Stay out of the way of signals the terminal sends to the
+     * foreground job, and do not outlive the shell */
+    setpgid(0, 0);
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+    if (getppid() != shell)
+        _exit(EXIT_SUCCESS);
+
+    static char buf[ZYGOTE_MAX_REQUEST];
+    for (;;) {
+        int fds[ZYGOTE_MAX_FDS], nfds;
+        ssize_t n = recv_with_fds(sock, buf, sizeof buf, fds, &nfds);
+        if (n <= 0)
+            _exit(n == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+        zygote_serve(sock, buf, n, fds, nfds);
+    }
+}
+
+bool
+zygote_start(void)
+{
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) == -1)
+        return false;
+
+    pid_t shell = getpid();
+    pid_t pid = fork();
+    if (pid == -1) {
+        int saved_errno = errno;
+        close(sv[0]);
+        close(sv[1]);
+        errno = saved_errno;
+        return false;
+    }
+    if (pid == 0) {
+        close(sv[0]);
+        zygote_main(sv[1], shell);
+    }
+
+    close(sv[1]);
+    zygote_sock = sv[0];
+    zygote_child = pid;
+    return true;
+}
+
+bool
+zygote_running(void)
+{
+    return zygote_sock != -1;
+}
+
+pid_t
+zygote_pid(void)
+{
+    return zygote_child;
+}
+
+/* Append 's' and its NUL to the request of length '*len' in 'buf' */
+static bool
+request_append(char *buf, size_t *len, const char *s)
+{
+    size_t n = strlen(s) + 1;
+    if (*len + n > ZYGOTE_MAX_REQUEST)
+        return false;
+    memcpy(buf + *len, s, n);
+    *len += n;
+    return true;
+}
+
+int
+zygote_spawn(const struct zygote_stage *stage, pid_t *pid, int *pidfd)
+{
+    static char buf[ZYGOTE_MAX_REQUEST];
+    struct zygote_request *req = (struct zygote_request *) buf;
+    size_t len = sizeof *req;
+    int fds[ZYGOTE_MAX_FDS], nfds = 0;
+
+    req->pgid = stage->pgid;
+    req->flags = 0;
+    req->argc = 0;
+    if (stage->foreground) {
+        req->flags |= ZYGOTE_FOREGROUND;
+        fds[nfds++] = termstate_get_tty_fd();
+    }
+    if (stage->in_fd != -1) {
+        req->flags |= ZYGOTE_PIPE_IN;
+        fds[nfds++] = stage->in_fd;
+    }
+    if (stage->out_fd != -1) {
+        req->flags |= ZYGOTE_PIPE_OUT;
+        fds[nfds++] = stage->out_fd;
+    }
+    if (stage->cgroup_fd != -1) {
+        req->flags |= ZYGOTE_CGROUP;
+        fds[nfds++] = stage->cgroup_fd;
+    }
+    if (stage->dup_stderr)
+        req->flags |= ZYGOTE_DUP_STDERR;
+    if (stage->append)
+        req->flags |= ZYGOTE_APPEND;
+    if (stage->cpus != NULL) {
+        req->flags |= ZYGOTE_AFFINITY;
+        req->cpus = *stage->cpus;
+    }
+    if (stage->policy != -1) {
+        req->flags |= ZYGOTE_SCHEDULER;
+        req->policy = stage->policy;
+    }
+
+    if (!request_append(buf, &len, stage->path))
+        return E2BIG;
+    if (stage->input != NULL) {
+        req->flags |= ZYGOTE_INPUT;
+        if (!request_append(buf, &len, stage->input))
+            return E2BIG;
+    }
+    if (stage->output != NULL) {
+        req->flags |= ZYGOTE_OUTPUT;
+        if (!request_append(buf, &len, stage->output))
+            return E2BIG;
+    }
+    for (char *const *arg = stage->argv; *arg; arg++, req->argc++)
+        if (!request_append(buf, &len, *arg))
+            return E2BIG;
+
+    struct zygote_reply reply;
+    int rfds[ZYGOTE_MAX_FDS], nrfds;
+    ssize_t n = -1;
+
+    /* cd changes only the shell's directory, so it is sent each time */
+    int cwd = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+    if (cwd == -1)
+        return errno;
+    fds[nfds++] = cwd;
+    bool sent = send_with_fds(zygote_sock, buf, len, fds, nfds) != -1;
+    close(cwd);
+    if (sent)
+        n = recv_with_fds(zygote_sock, &reply, sizeof reply, rfds, &nrfds);
+    if (n != sizeof reply) {
+        int error = n == -1 ? errno : EPIPE;
+        errno = error;
+        utils_error("spawner: ");
+        close(zygote_sock);
+        zygote_sock = -1;
+
+        /* It is the shell's child and no job's, so it is reaped here */
+        kill(zygote_child, SIGKILL);
+        waitpid(zygote_child, NULL, 0);
+        zygote_child = -1;
+        for (int i = 0; n != -1 && i < nrfds; i++)
+            close(rfds[i]);
+        return error;
+    }
+
+    *pidfd = nrfds > 0 ? rfds[0] : -1;
+    if (reply.error != 0) {
+        /* A child that failed to exec is the shell's to collect */
+        if (reply.pid > 0)
+            waitpid(reply.pid, NULL, 0);
+        return reply.error;
+    }
+    *pid = reply.pid;
+    return 0;
+}
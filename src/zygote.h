@@ -0,0 +1,62 @@
+#ifndef __ZYGOTE_H
+#define __ZYGOTE_H
+
+#include <sys/types.h>
+#include <stdbool.h>
+#include <sched.h>
+
+/*
+ * An optional helper process that spawns commands on the shell's
+ * behalf.
+ *
+ * It is forked when the shell starts, before readline, the history
+ * and the job table have grown, and stays that small.  The shell
+ * sends it a request per pipeline stage over a Unix socket, passing
+ * the pipe ends and the terminal along with it, and the helper runs
+ * posix_spawn().  Its children are created with CLONE_PARENT, so they
+ * are children of the shell, which reaps and controls them as if it
+ * had spawned them itself.
+ *
+ * The helper inherits the shell's environment and umask at startup.
+ * No builtin changes either, so the copies cannot get out of date.
+ * The current directory does change with cd, so each request carries
+ * the shell's, and the child moves there before its redirections are
+ * opened and its command is run.
+ */
+
+/* What a pipeline stage needs to be spawned */
+struct zygote_stage {
+    const char *path;           /* Executable to run */
+    char *const *argv;
+    pid_t pgid;                 /* Process group to join, 0 for a new one */
+    bool foreground;            /* Give it the terminal before it runs */
+    bool dup_stderr;            /* Send stderr where stdout goes */
+    int in_fd;                  /* Pipe to read from, -1 if none */
+    int out_fd;                 /* Pipe to write to, -1 if none */
+    const char *input;          /* File to read from, NULL if none */
+    const char *output;         /* File to write to, NULL if none */
+    bool append;                /* Append to 'output' */
+    const cpu_set_t *cpus;      /* CPUs it may run on, NULL if any */
+    int policy;                 /* Scheduling class, -1 for the shell's */
+    int cgroup_fd;              /* cgroup to run in, -1 for the shell's */
+};
+
+/* Start the helper.  Returns false, with errno set, if it could not
+ * be started. */
+bool zygote_start(void);
+
+/* Return true if the helper is running */
+bool zygote_running(void);
+
+/* Return the pid of the helper, a child of the shell that belongs to
+ * no job, or -1 if it was never started or has been shut down */
+pid_t zygote_pid(void);
+
+/* Have the helper spawn 'stage'.  Returns 0, with the new process's
+ * pid in '*pid' and a pidfd for it (or -1) in '*pidfd', or an error
+ * number like posix_spawn().  If the helper cannot be reached, it is
+ * shut down and reaped, zygote_running() returns false, and the stage
+ * and later ones should be spawned directly. */
+int zygote_spawn(const struct zygote_stage *stage, pid_t *pid, int *pidfd);
+
+#endif /* __ZYGOTE_H */
@@ -0,0 +1,60 @@
+#!/usr/bin/python
+#
+# Tests spawning through the helper process (cush -z): pipelines and
+# redirections work, also after cd, the spawned processes are the
+# shell's children, and the shell does without a helper that died.
+#
+import atexit, proc_check, time
+from testutils import *
+
+console = setup_tests([" -z"])
+
+# ensure that shell prints expected prompt
+expect_prompt()
+
+sendline("echo through the helper | tr a-z A-Z > zygote-test.txt")
+expect_prompt()
+sendline("cat < zygote-test.txt")
+expect_exact("THROUGH THE HELPER", "pipeline with redirections failed")
+expect_prompt()
+os.remove("zygote-test.txt")
+
+# the helper does not follow cd; the shell's directory goes with each
+# request, for relative redirections and for the child itself
+tmpdir = tempfile.mkdtemp()
+atexit.register(shutil.rmtree, tmpdir)
+sendline("cd %s" % tmpdir)
+expect_prompt()
+sendline("pwd > where.txt")
+expect_prompt()
+assert open(os.path.join(tmpdir, "where.txt")).read().strip() \
+    == os.path.realpath(tmpdir), "stage did not run in the shell's directory"
+sendline("cd %s" % os.getcwd())
+expect_prompt()
+
+# a background job is a child of the shell, not of the helper
+sendline("sleep 30 &")
+(jobid, pid) = parse_bg_status()
+expect_prompt()
+ppid = int(open("/proc/%s/stat" % pid).read().split(")")[1].split()[1])
+assert ppid == console.pid, "job is not the shell's child"
+
+run_builtin("kill", jobid)
+expect_prompt()
+
+# if the helper goes away, the stage is spawned directly and the helper
+# is reaped rather than left as a zombie
+children = "/proc/%d/task/%d/children" % (console.pid, console.pid)
+time.sleep(0.5)
+(helper,) = [int(p) for p in open(children).read().split()]
+os.kill(helper, signal.SIGKILL)
+time.sleep(0.2)
+sendline("echo spawned without the helper | tr a-z A-Z")
+expect_exact("SPAWNED WITHOUT THE HELPER", "stage failed with the helper gone")
+expect_prompt()
+assert open(children).read().split() == [], "helper was not reaped"
+
+sendline("exit")
+expect_exact("exit\r\n", "Shell output extraneous characters")
+
+test_success()